@@ -0,0 +1,177 @@
+/*
+Client throughput benchmark: runs the same command batch through VmcClient at several pipelining windows and reports
+throughput and latency for each, over MQTT (real device or sim/firmware_sim) or Serial (device or firmware_sim --pty)
+Window 1 is the stop-and-wait pattern (send, wait for the completion, send the next)
+*/
+#include "latency_histogram.h"
+#include "vmc_client.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using Clock = VmcClient::Clock;
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --host <addr>        MQTT broker host (default 127.0.0.1)\n"
+        "  --port <port>        MQTT broker port (default 1884, see mosquitto.conf)\n"
+        "  --root <topic>       MQTT topic root (default vmc, MQTT_TOPIC_ROOT in include/global.h)\n"
+        "  --device <id>        Controller device id (default sim0000, the first firmware_sim device)\n"
+        "  --serial <path>      Use the serial port (eg. /dev/ttyUSB0 or the path printed by firmware_sim --pty) instead of MQTT\n"
+        "  --commands <list>    Comma separated commands sent round robin (default \"stats;a1,idle;,stop;\", nothing dispensed)\n"
+        "  --allow-dispense     Allow disp/mdisp/vend in --commands, each one gives away a product on a real controller\n"
+        "  --count <n>          Commands per window (default 200)\n"
+        "  --windows <list>     Comma separated pipelining windows to compare (default \"1,2,5\")\n"
+        "  --timeout <ms>       Per attempt timeout (default 30000)\n", argv0);
+}
+
+static std::vector<std::string> splitList(const std::string &list) {
+    std::vector<std::string> items;
+    for (size_t start = 0; start < list.size();) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) {end = list.size();}
+        if (end > start) {items.push_back(list.substr(start, end - start));}
+        start = end + 1;
+    }
+    return items;
+}
+
+struct PhaseResult {
+    size_t window;
+    double elapsed;
+    uint64_t done = 0;
+    uint64_t failed = 0; // ERROR/INVALID/Rejected/Timeout
+    uint64_t retried = 0;
+    bool drained = true; // FALSE if commands were still outstanding at the drain timeout (counted as failed)
+    LatencyHistogram latency;
+};
+
+int main(int argc, char **argv) {
+    std::string host = "127.0.0.1";
+    int port = 1884;
+    std::string root = "vmc";
+    std::string device = "sim0000";
+    std::string serialPath;
+    std::string commandList = "stats;a1,idle;,stop;";
+    bool allowDispense = false;
+    size_t count = 200;
+    std::string windowList = "1,2,5";
+    double timeoutMs = 30000;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--host") && hasValue) {host = argv[++i];}
+        else if (!strcmp(argv[i], "--port") && hasValue) {port = atoi(argv[++i]);}
+        else if (!strcmp(argv[i], "--root") && hasValue) {root = argv[++i];}
+        else if (!strcmp(argv[i], "--device") && hasValue) {device = argv[++i];}
+        else if (!strcmp(argv[i], "--serial") && hasValue) {serialPath = argv[++i];}
+        else if (!strcmp(argv[i], "--commands") && hasValue) {commandList = argv[++i];}
+        else if (!strcmp(argv[i], "--allow-dispense")) {allowDispense = true;}
+        else if (!strcmp(argv[i], "--count") && hasValue) {count = (size_t)atoi(argv[++i]);}
+        else if (!strcmp(argv[i], "--windows") && hasValue) {windowList = argv[++i];}
+        else if (!strcmp(argv[i], "--timeout") && hasValue) {timeoutMs = atof(argv[++i]);}
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    std::vector<std::string> commands = splitList(commandList);
+    std::vector<size_t> windows;
+    bool windowsValid = true;
+    for (const std::string &window : splitList(windowList)) {
+        int value = atoi(window.c_str());
+        if (value < 1) {windowsValid = false;}
+        windows.push_back((size_t)value);
+    }
+    if (commands.empty() || windows.empty() || !windowsValid || count == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    for (const std::string &command : commands) {
+        if (!allowDispense && !VmcClient::retriable(command)) { // Dispensing commands are the ones never retried
+            fprintf(stderr, "[client_bench] \"%s\" dispenses, pass --allow-dispense to benchmark it\n", command.c_str());
+            return 1;
+        }
+    }
+
+    std::unique_ptr<VmcTransport> transport;
+    if (!serialPath.empty()) {
+        SerialTransport *serial = new SerialTransport();
+        transport.reset(serial);
+        if (!serial->open(serialPath)) {return 1;}
+        printf("[client_bench] Serial %s, %zu commands per window\n", serialPath.c_str(), count);
+    } else {
+        MqttTransport *mqtt = new MqttTransport(root, device, "vmc-client-bench");
+        transport.reset(mqtt);
+        if (!mqtt->connect(host, port)) {return 1;}
+        printf("[client_bench] MQTT %s:%d device %s, %zu commands per window\n", host.c_str(), port, device.c_str(), count);
+    }
+
+    VmcClientOptions options;
+    options.timeout = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(timeoutMs));
+
+    std::vector<PhaseResult> phases;
+    for (size_t window : windows) {
+        options.window = window;
+        PhaseResult phase;
+        phase.window = window;
+        std::mutex mutex;
+
+        Clock::time_point start = Clock::now();
+        {
+            // Destroyed before phase and mutex, outstanding commands complete (as Timeout) into them first
+            VmcClient client(*transport, options);
+            for (size_t i = 0; i < count; i++) {
+                client.submit(commands[i % commands.size()], [&](const VmcResult &result) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (result.ok()) {
+                        phase.done += 1;
+                        phase.latency.add(result.latencyMs);
+                    } else {
+                        phase.failed += 1;
+                    }
+                    if (result.attempts > 1) {phase.retried += 1;}
+                });
+            }
+            // Worst case every window's worth of commands uses all its attempts
+            size_t rounds = (count + window - 1) / window;
+            phase.drained = client.drain(options.timeout * (options.retries + 1) * rounds + std::chrono::seconds(1));
+            if (!phase.drained) {
+                fprintf(stderr, "[client_bench] Window %zu: %zu commands still outstanding at the drain timeout\n", window, client.pending());
+            }
+        }
+        phase.elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        phases.push_back(phase);
+    }
+
+    printf("%-7s %10s %8s %8s %8s %8s %8s %8s\n", "window", "cmd/s", "done", "failed", "retried", "p50 ms", "p99 ms", "max ms");
+    const PhaseResult *best = &phases.front();
+    for (const PhaseResult &phase : phases) {
+        printf("%-7zu %10.1f %8llu %8llu %8llu %8.1f %8.1f %8.1f\n", phase.window, phase.done / phase.elapsed,
+            (unsigned long long)phase.done, (unsigned long long)phase.failed, (unsigned long long)phase.retried,
+            phase.latency.percentile(50), phase.latency.percentile(99), phase.latency.max());
+        if (phase.done / phase.elapsed > best->done / best->elapsed) {best = &phase;}
+    }
+    printf("best    window %zu (VmcClientOptions default %d)\n", best->window, VMC_CONTROLLER_WINDOW);
+
+    // State snapshots: motorStateMatrix rows only come over Serial, statistics over both
+    VmcClient client(*transport, options);
+    VmcStateSnapshot snapshot;
+    VmcResult send = client.call("send;");
+    bool complete = VmcClient::parseStateMatrix(send, snapshot);
+    printf("snapshot send; %s, state matrix %s\n", send.ok() ? "DONE" : "FAILED", complete ? "complete" : "not sent (MQTT) or incomplete");
+    VmcResult stats = client.call("stats;");
+    printf("snapshot stats; %s, %zu motors\n", stats.ok() ? "DONE" : "FAILED", VmcClient::parseStats(stats).size());
+
+    for (const PhaseResult &phase : phases) {
+        if (phase.failed > 0 || !phase.drained) {return 2;}
+    }
+    return 0;
+}
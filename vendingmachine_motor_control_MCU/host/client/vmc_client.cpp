@@ -0,0 +1,224 @@
+#include "vmc_client.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+bool VmcStateSnapshot::complete() const {
+    for (bool received : rowReceived) {
+        if (!received) {return false;}
+    }
+    return true;
+}
+
+VmcClient::VmcClient(VmcTransport &transport, const VmcClientOptions &options) : transport_(transport), options_(options) {
+    if (options_.window == 0) {options_.window = 1;}
+    transport_.onLine([this](const std::string &line) { handleLine(line); });
+    timer_ = std::thread(&VmcClient::timer, this);
+}
+
+VmcClient::~VmcClient() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    idleCond_.notify_all();
+    timer_.join();
+    transport_.onLine(nullptr); // Waits for a line being handled
+
+    std::vector<Completion> done;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (!pending_.empty()) {completeLocked(pending_.begin()->first, VmcResult::Status::Timeout, "", 0, done);}
+    }
+    finish(done);
+}
+
+bool VmcClient::retriable(const std::string &command) {
+    return !ReplyMatcher::dispenses(command);
+}
+
+void VmcClient::submit(const std::string &command, Callback callback) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t id = nextId_++;
+        Pending &request = pending_[id];
+        request.command = command;
+        request.callback = std::move(callback);
+        backlog_.push_back(id);
+    }
+    pump();
+}
+
+std::future<VmcResult> VmcClient::submit(const std::string &command) {
+    auto promise = std::make_shared<std::promise<VmcResult>>();
+    std::future<VmcResult> result = promise->get_future();
+    submit(command, [promise](const VmcResult &r) { promise->set_value(r); });
+    return result;
+}
+
+bool VmcClient::drain(Clock::duration timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return idleCond_.wait_for(lock, timeout, [this] { return pending_.empty() && finishing_ == 0; });
+}
+
+size_t VmcClient::pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_.size();
+}
+
+// Sends held commands while the window has room
+void VmcClient::pump() {
+    std::lock_guard<std::mutex> sendLock(sendMutex_);
+    while (true) {
+        std::string command;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_ || backlog_.empty() || matcher_.outstanding() >= options_.window) {return;}
+            uint64_t id = backlog_.front();
+            backlog_.pop_front();
+            Pending &request = pending_[id];
+            request.attempts += 1;
+            command = request.command;
+            matcher_.add({id, ReplyMatcher::actionOf(command), Clock::now(), transport_.reconnects()});
+            if (transport_.acknowledgesReceipt()) {unacked_.push_back(id);}
+        }
+        // A failed send is left to the timeout (and retry policy)
+        transport_.send(command);
+    }
+}
+
+void VmcClient::handleLine(const std::string &line) {
+    if (line.compare(0, 8, "[Logger]") == 0) {return;} // Logger shares UART0 with Serial unless LOGGER_TX is set
+
+    std::vector<Completion> done;
+    bool confirmRow = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (line == "RECEIVE SUCCESS" || line == "RECEIVE FAIL") {
+            // Every command line is acknowledged exactly once and in order, possibly after its completion
+            if (unacked_.empty()) {return;}
+            uint64_t id = unacked_.front();
+            unacked_.pop_front();
+            // Rejected on receipt, never queued by the controller so always safe to resend
+            if (line == "RECEIVE FAIL" && matcher_.cancel(id)) {retryOrFailLocked(id, VmcResult::Status::Rejected, done);}
+        } else {
+            Clock::time_point now = Clock::now();
+            ReplyMatcher::Match match = matcher_.match(line);
+            if (match.kind == ReplyMatcher::Kind::Informational) {
+                const ReplyMatcher::Request *executing = matcher_.oldest();
+                if (executing) {pending_[executing->id].lines.push_back(line);}
+                // sendMotorStateMatrix waits for a confirmation of every row before sending the next one
+                confirmRow = transport_.acknowledgesReceipt() && line.compare(0, 3, "ROW") == 0 && line.size() > 3 && isdigit((unsigned char)line[3]);
+            } else if (match.kind == ReplyMatcher::Kind::Completed) {
+                VmcResult::Status status = VmcResult::Status::Done;
+                if (line.compare(0, 8, "INVALID ") == 0) {
+                    status = VmcResult::Status::Invalid;
+                } else if (match.error) {
+                    status = VmcResult::Status::Error;
+                }
+                completeLocked(match.request.id, status, line, std::chrono::duration<double, std::milli>(now - match.request.sent).count(), done);
+            }
+            // Late and duplicate replies (eg. to an attempt that already timed out) are dropped
+        }
+    }
+    if (confirmRow) {transport_.send("rowreceived");}
+    finish(done);
+    pump();
+}
+
+void VmcClient::timer() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        idleCond_.wait_for(lock, std::chrono::milliseconds(10));
+        if (stopping_) {break;}
+        std::vector<Completion> done;
+        for (const ReplyMatcher::Request &request : matcher_.expire(Clock::now(), options_.timeout)) {
+            // A line lost on the wire is never acknowledged, drop it so later acknowledgements stay aligned
+            for (auto unacked = unacked_.begin(); unacked != unacked_.end(); ++unacked) {
+                if (*unacked == request.id) {
+                    unacked_.erase(unacked);
+                    break;
+                }
+            }
+            retryOrFailLocked(request.id, VmcResult::Status::Timeout, done);
+        }
+        if (done.empty() && backlog_.empty()) {continue;}
+        lock.unlock();
+        finish(done);
+        pump();
+        lock.lock();
+    }
+}
+
+// Puts the request back at the head of the backlog if the retry policy allows, otherwise completes it with status
+void VmcClient::retryOrFailLocked(uint64_t id, VmcResult::Status status, std::vector<Completion> &done) {
+    Pending &request = pending_[id];
+    if (request.attempts <= options_.retries && (status == VmcResult::Status::Rejected || retriable(request.command))) {
+        request.lines.clear();
+        backlog_.push_front(id);
+        return;
+    }
+    completeLocked(id, status, "", 0, done);
+}
+
+void VmcClient::completeLocked(uint64_t id, VmcResult::Status status, const std::string &reply, double latencyMs, std::vector<Completion> &done) {
+    auto request = pending_.find(id);
+    if (request == pending_.end()) {return;}
+    VmcResult result;
+    result.status = status;
+    result.command = request->second.command;
+    result.reply = reply;
+    result.lines = std::move(request->second.lines);
+    result.latencyMs = latencyMs;
+    result.attempts = request->second.attempts;
+    done.emplace_back(std::move(request->second.callback), std::move(result));
+    pending_.erase(request);
+    finishing_ += 1;
+}
+
+void VmcClient::finish(std::vector<Completion> &done) {
+    for (Completion &completion : done) {
+        if (completion.first) {completion.first(completion.second);}
+    }
+    if (done.empty()) {return;}
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finishing_ -= done.size();
+    }
+    idleCond_.notify_all();
+    done.clear();
+}
+
+// Parses the ROWn;<flag>,<flag>,... lines of a send; result, rows repeated after a missed confirmation are overwritten
+bool VmcClient::parseStateMatrix(const VmcResult &result, VmcStateSnapshot &snapshot) {
+    for (const std::string &line : result.lines) {
+        int row = -1;
+        int offset = 0;
+        if (sscanf(line.c_str(), "ROW%d;%n", &row, &offset) != 1 || offset == 0 || row < 0 || row >= 6) {continue;}
+        const char *p = line.c_str() + offset;
+        int col = 0;
+        while (*p && col < 8) {
+            char *end = nullptr;
+            long flag = strtol(p, &end, 10);
+            if (end == p) {break;}
+            snapshot.state[row][col++] = (uint8_t)flag;
+            p = *end == ',' ? end + 1 : end;
+        }
+        snapshot.rowReceived[row] = col == 8;
+    }
+    return snapshot.complete();
+}
+
+std::vector<VmcMotorStats> VmcClient::parseStats(const VmcResult &result) {
+    std::vector<VmcMotorStats> stats;
+    for (const std::string &line : result.lines) {
+        VmcMotorStats motor;
+        if (sscanf(line.c_str(), "STATS;%c%c;%u;%u;%f;%f;%f;%f;%f", &motor.row, &motor.col, &motor.runs, &motor.failures,
+                &motor.currentMean, &motor.currentSd, &motor.revMean, &motor.revSd, &motor.drift) == 9) {
+            stats.push_back(motor);
+        }
+    }
+    return stats;
+}
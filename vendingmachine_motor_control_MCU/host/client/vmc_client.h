@@ -0,0 +1,129 @@
+#ifndef VMC_CLIENT_H
+#define VMC_CLIENT_H
+
+#include "reply_matcher.h"
+#include "vmc_transport.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Mirrors COMMAND_QUEUE_LEN in include/command_handling.h: commands the controller accepts at once (queue + executing)
+#define VMC_CONTROLLER_WINDOW 5
+
+struct VmcClientOptions {
+    size_t window = VMC_CONTROLLER_WINDOW; // Commands sent ahead of their replies, more are held by the client
+    ReplyMatcher::Clock::duration timeout = std::chrono::seconds(30); // Per attempt, from send to completion
+    unsigned retries = 2; // Extra attempts for commands that are safe to repeat (see VmcClient::retriable)
+};
+
+struct VmcResult {
+    enum class Status {
+        Done, // "<action> DONE ..."
+        Error, // Completed with an ERROR result (eg. "disp ERROR 2: HOME TIMEOUT")
+        Invalid, // "INVALID ..." (bad cell, sku, ...)
+        Rejected, // RECEIVE FAIL on every attempt (Serial)
+        Timeout // No completion within timeout on every attempt
+    };
+
+    Status status = Status::Timeout;
+    std::string command;
+    std::string reply; // Completion line
+    std::vector<std::string> lines; // Informational lines sent while the command executed (STATS;..., PLAN;..., ROWn;..., Error;...)
+    double latencyMs = 0; // Last attempt, send to completion
+    unsigned attempts = 0;
+
+    bool ok() const { return status == Status::Done; }
+};
+
+// Parsed motorStateMatrix ("send;" over Serial)
+struct VmcStateSnapshot {
+    uint8_t state[6][8] = {}; // motorStateMatrix flags (0 = functional)
+    bool rowReceived[6] = {};
+    bool complete() const;
+};
+
+// Parsed "STATS;<cell>;<runs>;<failures>;<i_mean>;<i_sd>;<t_mean>;<t_sd>;<drift>" line
+struct VmcMotorStats {
+    char row = 0;
+    char col = 0;
+    unsigned runs = 0;
+    unsigned failures = 0;
+    float currentMean = 0;
+    float currentSd = 0;
+    float revMean = 0;
+    float revSd = 0;
+    float drift = 0;
+};
+
+/*
+Asynchronous client for one controller over any VmcTransport
+Commands are pipelined: up to options.window are sent ahead of their replies (the controller queues them), the rest are
+held here and sent as completions arrive. Completions are matched to requests by ReplyMatcher, informational lines are
+attached to the command executing at the time. Over Serial, RECEIVE SUCCESS/FAIL acknowledgements and the ROWn/rowreceived
+handshake of send; are handled here
+Callbacks run on the transport or timer thread without the client lock held, they may submit further commands
+*/
+class VmcClient {
+public:
+    using Clock = ReplyMatcher::Clock;
+    using Callback = std::function<void(const VmcResult &)>;
+
+    explicit VmcClient(VmcTransport &transport, const VmcClientOptions &options = VmcClientOptions());
+    ~VmcClient(); // Outstanding commands complete with Timeout
+
+    VmcClient(const VmcClient &) = delete;
+    VmcClient &operator=(const VmcClient &) = delete;
+
+    void submit(const std::string &command, Callback callback);
+    std::future<VmcResult> submit(const std::string &command);
+    VmcResult call(const std::string &command) { return submit(command).get(); }
+
+    bool drain(Clock::duration timeout); // Waits until every submitted command completed and its callback returned, FALSE on timeout
+    size_t pending() const; // Submitted and not yet completed
+
+    static bool retriable(const std::string &command); // Repeating it can't dispense twice (everything but disp, mdisp, vend)
+    static bool parseStateMatrix(const VmcResult &result, VmcStateSnapshot &snapshot);
+    static std::vector<VmcMotorStats> parseStats(const VmcResult &result);
+
+private:
+    struct Pending {
+        std::string command;
+        Callback callback;
+        unsigned attempts = 0;
+        std::vector<std::string> lines;
+    };
+    using Completion = std::pair<Callback, VmcResult>;
+
+    void handleLine(const std::string &line);
+    void pump();
+    void timer();
+    void retryOrFailLocked(uint64_t id, VmcResult::Status status, std::vector<Completion> &done);
+    void completeLocked(uint64_t id, VmcResult::Status status, const std::string &reply, double latencyMs, std::vector<Completion> &done);
+    void finish(std::vector<Completion> &done);
+
+    VmcTransport &transport_;
+    VmcClientOptions options_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable idleCond_; // Signalled as commands complete and on shutdown
+    ReplyMatcher matcher_;
+    std::map<uint64_t, Pending> pending_;
+    size_t finishing_ = 0; // Completed but callback not yet returned
+    std::deque<uint64_t> backlog_; // Waiting for a window slot, retries go first
+    std::deque<uint64_t> unacked_; // Sent, waiting for RECEIVE SUCCESS/FAIL (Serial)
+    uint64_t nextId_ = 0;
+    bool stopping_ = false;
+
+    std::mutex sendMutex_; // Keeps matcher order and wire order the same
+    std::thread timer_;
+};
+
+#endif
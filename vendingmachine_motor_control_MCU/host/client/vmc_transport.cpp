@@ -0,0 +1,121 @@
+#include "vmc_transport.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+MqttTransport::MqttTransport(const std::string &root, const std::string &device, const std::string &clientId)
+    : incomingTopic_(root + "/" + device + "/hostToClient"), outgoingTopic_(root + "/" + device + "/clientToHost"), link_(clientId) {
+    link_.onMessage([this](const std::string &topic, const std::string &payload) {
+        if (topic == outgoingTopic_) {deliver(payload);}
+    });
+    link_.subscribe(outgoingTopic_);
+}
+
+bool MqttTransport::connect(const std::string &host, int port, std::chrono::milliseconds timeout) {
+    if (!link_.connect(host, port)) {return false;}
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!link_.connected()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            fprintf(stderr, "[MqttTransport] no connection to %s:%d within %lld ms\n", host.c_str(), port, (long long)timeout.count());
+            link_.disconnect();
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+bool MqttTransport::send(const std::string &command) {
+    return link_.publish(incomingTopic_, command);
+}
+
+SerialTransport::~SerialTransport() {
+    close();
+}
+
+static speed_t baudConstant(int baud) {
+    switch (baud) {
+        case 9600: return B9600;
+        case 57600: return B57600;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default: return B115200;
+    }
+}
+
+bool SerialTransport::open(const std::string &path, int baud) {
+    fd_ = ::open(path.c_str(), O_RDWR | O_NOCTTY);
+    if (fd_ < 0) {
+        fprintf(stderr, "[SerialTransport] open %s failed: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+    struct termios tty;
+    if (tcgetattr(fd_, &tty) != 0) {
+        fprintf(stderr, "[SerialTransport] %s is not a tty\n", path.c_str());
+        close();
+        return false;
+    }
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, baudConstant(baud));
+    cfsetospeed(&tty, baudConstant(baud));
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 1; // Reads return at least every 100 ms so close() is noticed
+    tcsetattr(fd_, TCSANOW, &tty);
+    tcflush(fd_, TCIOFLUSH);
+
+    running_ = true;
+    reader_ = std::thread(&SerialTransport::reader, this);
+    return true;
+}
+
+void SerialTransport::close() {
+    running_ = false;
+    if (reader_.joinable()) {reader_.join();}
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool SerialTransport::send(const std::string &command) {
+    std::string line = command + "\n";
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    size_t written = 0;
+    while (written < line.size()) {
+        ssize_t n = ::write(fd_, line.data() + written, line.size() - written);
+        if (n < 0 && errno == EINTR) {continue;}
+        if (n <= 0) {return false;}
+        written += (size_t)n;
+    }
+    return true;
+}
+
+// Splits the byte stream into lines like the firmware's serialHandler ('\r' ignored, '\n' terminates)
+void SerialTransport::reader() {
+    std::string line;
+    char buffer[256];
+    while (running_) {
+        ssize_t n = ::read(fd_, buffer, sizeof(buffer));
+        if (n < 0 && errno != EINTR && errno != EAGAIN) {
+            // A pty reports EIO while its other side is closed
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+        for (ssize_t i = 0; i < n; i++) {
+            if (buffer[i] == '\r') {continue;}
+            if (buffer[i] != '\n') {
+                line += buffer[i];
+                continue;
+            }
+            if (!line.empty()) {deliver(line);}
+            line.clear();
+        }
+    }
+}
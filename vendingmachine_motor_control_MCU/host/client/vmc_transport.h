@@ -0,0 +1,87 @@
+#ifndef VMC_TRANSPORT_H
+#define VMC_TRANSPORT_H
+
+#include "mqtt_link.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/*
+Line transport to one controller, used by VmcClient
+Lines are delivered from the transport's own thread, one controller response per line
+*/
+class VmcTransport {
+public:
+    using LineHandler = std::function<void(const std::string &line)>;
+
+    virtual ~VmcTransport() = default;
+
+    virtual bool send(const std::string &command) = 0; // One command or confirmation, without terminator
+    virtual bool acknowledgesReceipt() const = 0; // Controller answers every command with RECEIVE SUCCESS/FAIL (Serial only)
+    virtual unsigned reconnects() const = 0;
+
+    void onLine(LineHandler handler) {
+        std::lock_guard<std::mutex> lock(handlerMutex_);
+        lineHandler_ = std::move(handler);
+    }
+
+protected:
+    void deliver(const std::string &line) {
+        std::lock_guard<std::mutex> lock(handlerMutex_);
+        if (lineHandler_) {lineHandler_(line);}
+    }
+
+private:
+    std::mutex handlerMutex_;
+    LineHandler lineHandler_;
+};
+
+// Controller on a broker: commands on <root>/<device>/hostToClient, responses on <root>/<device>/clientToHost
+class MqttTransport : public VmcTransport {
+public:
+    MqttTransport(const std::string &root, const std::string &device, const std::string &clientId);
+
+    // Returns once connected, FALSE if the broker is unreachable or the connection isn't accepted within timeout
+    bool connect(const std::string &host, int port, std::chrono::milliseconds timeout = std::chrono::seconds(10));
+    void disconnect() { link_.disconnect(); }
+
+    bool send(const std::string &command) override;
+    bool acknowledgesReceipt() const override { return false; }
+    unsigned reconnects() const override { return link_.disconnects(); }
+
+private:
+    std::string incomingTopic_;
+    std::string outgoingTopic_;
+    MqttLink link_;
+};
+
+// Controller on a serial port (USB UART at 115200 baud, or a pty from firmware_sim --pty)
+class SerialTransport : public VmcTransport {
+public:
+    SerialTransport() = default;
+    ~SerialTransport();
+
+    SerialTransport(const SerialTransport &) = delete;
+    SerialTransport &operator=(const SerialTransport &) = delete;
+
+    bool open(const std::string &path, int baud = 115200); // Raw 8N1, starts the reader thread
+    void close();
+
+    bool send(const std::string &command) override;
+    bool acknowledgesReceipt() const override { return true; }
+    unsigned reconnects() const override { return 0; }
+
+private:
+    void reader();
+
+    int fd_ = -1;
+    std::mutex writeMutex_;
+    std::atomic<bool> running_{false};
+    std::thread reader_;
+};
+
+#endif
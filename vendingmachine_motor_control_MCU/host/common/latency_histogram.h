@@ -0,0 +1,57 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <cmath>
+#include <cstdint>
+
+/*
+Fixed size log-scale latency histogram (0.1 ms .. 1000 s, 20 buckets per decade, ~12% bucket width)
+Constant memory for long running aggregation where keeping every sample is not an option
+*/
+class LatencyHistogram {
+public:
+    static const int BUCKETS_PER_DECADE = 20;
+    static const int DECADES = 7;
+    static const int BUCKETS = BUCKETS_PER_DECADE * DECADES;
+
+    void add(double ms) {
+        int bucket = ms <= 0.1 ? 0 : (int)(std::log10(ms / 0.1) * BUCKETS_PER_DECADE);
+        if (bucket >= BUCKETS) {bucket = BUCKETS - 1;}
+        counts_[bucket] += 1;
+        count_ += 1;
+        sum_ += ms;
+        if (ms > max_) {max_ = ms;}
+    }
+
+    // Upper bound of the bucket holding percentile p (0..100)
+    double percentile(double p) const {
+        if (count_ == 0) {return 0;}
+        uint64_t rank = (uint64_t)std::ceil(p / 100.0 * count_);
+        if (rank == 0) {rank = 1;}
+        uint64_t seen = 0;
+        for (int bucket = 0; bucket < BUCKETS; bucket++) {
+            seen += counts_[bucket];
+            if (seen >= rank) {return std::fmin(0.1 * std::pow(10.0, (double)(bucket + 1) / BUCKETS_PER_DECADE), max_);}
+        }
+        return max_;
+    }
+
+    void merge(const LatencyHistogram &other) {
+        for (int bucket = 0; bucket < BUCKETS; bucket++) {counts_[bucket] += other.counts_[bucket];}
+        count_ += other.count_;
+        sum_ += other.sum_;
+        if (other.max_ > max_) {max_ = other.max_;}
+    }
+
+    uint64_t count() const { return count_; }
+    double mean() const { return count_ ? sum_ / count_ : 0; }
+    double max() const { return max_; }
+
+private:
+    uint64_t counts_[BUCKETS] = {};
+    uint64_t count_ = 0;
+    double sum_ = 0;
+    double max_ = 0;
+};
+
+#endif
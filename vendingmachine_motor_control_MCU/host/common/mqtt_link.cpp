@@ -0,0 +1,99 @@
+#include "mqtt_link.h"
+
+#include <mosquitto.h>
+#include <cstdio>
+
+namespace {
+std::mutex libMutex;
+int libUsers = 0;
+}
+
+MqttLink::MqttLink(const std::string &clientId) {
+    {
+        std::lock_guard<std::mutex> lock(libMutex);
+        if (libUsers++ == 0) {mosquitto_lib_init();}
+    }
+    mosq_ = mosquitto_new(clientId.c_str(), true, this);
+    if (mosq_) {
+        mosquitto_connect_callback_set(mosq_, handleConnect);
+        mosquitto_disconnect_callback_set(mosq_, handleDisconnect);
+        mosquitto_message_callback_set(mosq_, handleMessage);
+        mosquitto_reconnect_delay_set(mosq_, 1, 8, true);
+    }
+}
+
+MqttLink::~MqttLink() {
+    disconnect();
+    if (mosq_) {mosquitto_destroy(mosq_);}
+    std::lock_guard<std::mutex> lock(libMutex);
+    if (--libUsers == 0) {mosquitto_lib_cleanup();}
+}
+
+bool MqttLink::setWill(const std::string &topic, const std::string &payload, bool retain) {
+    if (!mosq_) {return false;}
+    return mosquitto_will_set(mosq_, topic.c_str(), (int)payload.size(), payload.data(), 1, retain) == MOSQ_ERR_SUCCESS;
+}
+
+bool MqttLink::connect(const std::string &host, int port, int keepalive) {
+    if (!mosq_) {return false;}
+    int rc = mosquitto_connect(mosq_, host.c_str(), port, keepalive);
+    if (rc != MOSQ_ERR_SUCCESS) {
+        fprintf(stderr, "[MqttLink] connect to %s:%d failed: %s\n", host.c_str(), port, mosquitto_strerror(rc));
+        return false;
+    }
+    if (mosquitto_loop_start(mosq_) != MOSQ_ERR_SUCCESS) {return false;}
+    loopRunning_ = true;
+    return true;
+}
+
+void MqttLink::disconnect() {
+    if (!mosq_ || !loopRunning_) {return;}
+    loopRunning_ = false;
+    mosquitto_disconnect(mosq_);
+    mosquitto_loop_stop(mosq_, false);
+    std::lock_guard<std::mutex> lock(subscriptionsMutex_);
+    connected_ = false;
+}
+
+bool MqttLink::subscribe(const std::string &topic) {
+    // Checked under the lock handleConnect sets connected_ under, so a connect in between can't miss the topic
+    std::lock_guard<std::mutex> lock(subscriptionsMutex_);
+    subscriptions_.push_back(topic);
+    // If not connected yet the subscription is made in handleConnect
+    if (!connected_) {return true;}
+    return mosquitto_subscribe(mosq_, nullptr, topic.c_str(), 0) == MOSQ_ERR_SUCCESS;
+}
+
+bool MqttLink::publish(const std::string &topic, const std::string &payload, bool retain) {
+    return mosquitto_publish(mosq_, nullptr, topic.c_str(), (int)payload.size(), payload.data(), 0, retain) == MOSQ_ERR_SUCCESS;
+}
+
+void MqttLink::handleConnect(mosquitto *mosq, void *obj, int rc) {
+    MqttLink *self = static_cast<MqttLink *>(obj);
+    if (rc != 0) {return;}
+    {
+        std::lock_guard<std::mutex> lock(self->subscriptionsMutex_);
+        for (const std::string &topic : self->subscriptions_) {
+            mosquitto_subscribe(mosq, nullptr, topic.c_str(), 0);
+        }
+        self->connected_ = true;
+    }
+    if (self->connectionHandler_) {self->connectionHandler_(true);}
+}
+
+void MqttLink::handleDisconnect(mosquitto *, void *obj, int rc) {
+    MqttLink *self = static_cast<MqttLink *>(obj);
+    {
+        std::lock_guard<std::mutex> lock(self->subscriptionsMutex_);
+        self->connected_ = false;
+    }
+    if (rc != 0) {self->disconnects_ += 1;} // rc == 0 is a disconnect we asked for
+    if (self->connectionHandler_) {self->connectionHandler_(false);}
+}
+
+void MqttLink::handleMessage(mosquitto *, void *obj, const mosquitto_message *msg) {
+    MqttLink *self = static_cast<MqttLink *>(obj);
+    if (!self->messageHandler_) {return;}
+    std::string payload(static_cast<const char *>(msg->payload), msg->payloadlen);
+    self->messageHandler_(msg->topic, payload);
+}
@@ -0,0 +1,57 @@
+#ifndef MQTT_LINK_H
+#define MQTT_LINK_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct mosquitto;
+struct mosquitto_message;
+
+/*
+Thin C++ wrapper around libmosquitto shared by the host tools
+Runs the network loop on libmosquitto's own thread, reconnects automatically and restores subscriptions after a reconnect
+Message handlers are called from the network thread
+*/
+class MqttLink {
+public:
+    using MessageHandler = std::function<void(const std::string &topic, const std::string &payload)>;
+    using ConnectionHandler = std::function<void(bool connected)>;
+
+    explicit MqttLink(const std::string &clientId);
+    ~MqttLink();
+
+    MqttLink(const MqttLink &) = delete;
+    MqttLink &operator=(const MqttLink &) = delete;
+
+    bool setWill(const std::string &topic, const std::string &payload, bool retain = true); // Call before connect()
+    bool connect(const std::string &host, int port, int keepalive = 30); // Starts network thread, returns false if broker unreachable
+    void disconnect();
+
+    bool subscribe(const std::string &topic);
+    bool publish(const std::string &topic, const std::string &payload, bool retain = false);
+
+    void onMessage(MessageHandler handler) { messageHandler_ = std::move(handler); }
+    void onConnection(ConnectionHandler handler) { connectionHandler_ = std::move(handler); }
+
+    bool connected() const { return connected_; }
+    unsigned disconnects() const { return disconnects_; } // Unexpected disconnects since connect()
+
+private:
+    static void handleConnect(mosquitto *mosq, void *obj, int rc);
+    static void handleDisconnect(mosquitto *mosq, void *obj, int rc);
+    static void handleMessage(mosquitto *mosq, void *obj, const mosquitto_message *msg);
+
+    mosquitto *mosq_ = nullptr;
+    MessageHandler messageHandler_;
+    ConnectionHandler connectionHandler_;
+    std::mutex subscriptionsMutex_; // Guards subscriptions_ and changes of connected_
+    std::vector<std::string> subscriptions_;
+    std::atomic<bool> connected_{false};
+    std::atomic<unsigned> disconnects_{0};
+    bool loopRunning_ = false;
+};
+
+#endif
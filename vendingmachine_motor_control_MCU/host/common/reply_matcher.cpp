@@ -0,0 +1,75 @@
+#include "reply_matcher.h"
+
+#include <algorithm>
+
+// Bound on remembered expired requests, older ones are forgotten and their replies count as duplicates
+#define REPLY_MATCHER_MAX_EXPIRED 256
+
+std::string ReplyMatcher::actionOf(const std::string &command) {
+    size_t delimiter = command.find(';');
+    return delimiter == std::string::npos ? command : command.substr(0, delimiter);
+}
+
+bool ReplyMatcher::dispenses(const std::string &command) {
+    std::string action = actionOf(command);
+    return action == "disp" || action == "mdisp" || action == "vend";
+}
+
+std::string ReplyMatcher::completedAction(const std::string &reply) {
+    if (reply.compare(0, 8, "INVALID ") == 0) {return "INVALID";}
+    size_t space = reply.find(' ');
+    if (space == std::string::npos || reply.find(';') < space) {return "";}
+    return reply.substr(0, space);
+}
+
+ReplyMatcher::Match ReplyMatcher::match(const std::string &reply) {
+    Match result = {Kind::Informational, Request(), false};
+    std::string action = completedAction(reply);
+    if (action.empty()) {return result;}
+    result.error = action == "INVALID" || reply.find("ERROR") != std::string::npos;
+
+    auto sameAction = [&action](const std::string &requestAction) {
+        return action == "INVALID" || requestAction == action;
+    };
+    auto request = std::find_if(outstanding_.begin(), outstanding_.end(), [&](const Request &r) { return sameAction(r.action); });
+    if (request != outstanding_.end()) {
+        result.kind = Kind::Completed;
+        result.request = *request;
+        outstanding_.erase(request);
+        return result;
+    }
+    auto expired = std::find_if(expiredActions_.begin(), expiredActions_.end(), sameAction);
+    if (expired != expiredActions_.end()) {
+        result.kind = Kind::Late;
+        expiredActions_.erase(expired);
+    } else {
+        result.kind = Kind::Duplicate;
+    }
+    return result;
+}
+
+std::vector<ReplyMatcher::Request> ReplyMatcher::expire(Clock::time_point now, Clock::duration timeout) {
+    std::vector<Request> expired;
+    while (!outstanding_.empty() && now - outstanding_.front().sent > timeout) {
+        expired.push_back(outstanding_.front());
+        expiredActions_.push_back(outstanding_.front().action);
+        outstanding_.pop_front();
+    }
+    while (expiredActions_.size() > REPLY_MATCHER_MAX_EXPIRED) {expiredActions_.pop_front();}
+    return expired;
+}
+
+std::vector<ReplyMatcher::Request> ReplyMatcher::expireAll() {
+    std::vector<Request> expired(outstanding_.begin(), outstanding_.end());
+    for (const Request &request : outstanding_) {expiredActions_.push_back(request.action);}
+    outstanding_.clear();
+    while (expiredActions_.size() > REPLY_MATCHER_MAX_EXPIRED) {expiredActions_.pop_front();}
+    return expired;
+}
+
+bool ReplyMatcher::cancel(uint64_t id) {
+    auto request = std::find_if(outstanding_.begin(), outstanding_.end(), [id](const Request &r) { return r.id == id; });
+    if (request == outstanding_.end()) {return false;}
+    outstanding_.erase(request);
+    return true;
+}
@@ -0,0 +1,57 @@
+#ifndef REPLY_MATCHER_H
+#define REPLY_MATCHER_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+/*
+Matches controller replies to outstanding requests of one controller
+Replies carry no request id, the controller executes commands one at a time in arrival order, so a reply completes
+the oldest outstanding request of the same action ("INVALID ..." replies name no action and complete the oldest request)
+Not thread safe, callers serialise access
+*/
+class ReplyMatcher {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Request {
+        uint64_t id;
+        std::string action;
+        Clock::time_point sent;
+        unsigned tag; // Caller defined (eg. reconnect count when sent)
+    };
+
+    enum class Kind {
+        Informational, // Not a completion (STATS;..., PLAN;..., Error;Motor..., etc.)
+        Completed,
+        Late, // Completes a request that already expired
+        Duplicate // No request to complete
+    };
+
+    struct Match {
+        Kind kind;
+        Request request; // Valid for Completed
+        bool error; // Reply reports ERROR/INVALID
+    };
+
+    void add(const Request &request) { outstanding_.push_back(request); }
+    Match match(const std::string &reply);
+    std::vector<Request> expire(Clock::time_point now, Clock::duration timeout); // Returns expired requests, oldest first
+    std::vector<Request> expireAll();
+    bool cancel(uint64_t id); // Drops a request that will never be answered (eg. rejected on receipt), FALSE if unknown
+    size_t outstanding() const { return outstanding_.size(); }
+    const Request *oldest() const { return outstanding_.empty() ? nullptr : &outstanding_.front(); } // The one executing
+
+    static std::string actionOf(const std::string &command); // "disp;a1" -> "disp"
+    static bool dispenses(const std::string &command); // disp, mdisp and vend give away a product on a real controller
+    static std::string completedAction(const std::string &reply); // "disp DONE" -> "disp", empty if informational
+
+private:
+    std::deque<Request> outstanding_; // In send order
+    std::deque<std::string> expiredActions_; // Actions of expired requests, for late reply matching
+};
+
+#endif
@@ -0,0 +1,167 @@
+/*
+Fleet benchmark: drives every controller on the broker (eg. firmware_sim --devices 200) through FleetGateway
+Waits for the expected number of controllers to come online, keeps each one's window of commands full for the duration
+and reports aggregate throughput, latency percentiles, drops and how evenly the fleet was served
+*/
+#include "fleet_gateway.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = FleetGateway::Clock;
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --host <addr>        MQTT broker host (default 127.0.0.1)\n"
+        "  --port <port>        MQTT broker port (default 1884, see mosquitto.conf)\n"
+        "  --root <topic>       MQTT topic root (default vmc, MQTT_TOPIC_ROOT in include/global.h)\n"
+        "  --devices <n>        Controllers to wait for before starting (default 1)\n"
+        "  --commands <list>    Comma separated commands sent round robin to each controller (default \"stats;a1,idle;\", nothing dispensed)\n"
+        "  --allow-dispense     Allow disp/mdisp/vend in --commands, each one gives away a product on every real controller\n"
+        "  --window <n>         Commands kept queued per controller (default 5, the gateway's per controller window)\n"
+        "  --duration <s>       Send duration (default 30)\n"
+        "  --timeout <ms>       Reply timeout before a command counts as dropped (default 30000)\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    std::string host = "127.0.0.1";
+    int port = 1884;
+    std::string root = "vmc";
+    size_t expectedDevices = 1;
+    std::string commandList = "stats;a1,idle;";
+    bool allowDispense = false;
+    size_t window = FLEET_DEVICE_WINDOW;
+    double duration = 30;
+    double timeoutMs = 30000;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--host") && hasValue) {host = argv[++i];}
+        else if (!strcmp(argv[i], "--port") && hasValue) {port = atoi(argv[++i]);}
+        else if (!strcmp(argv[i], "--root") && hasValue) {root = argv[++i];}
+        else if (!strcmp(argv[i], "--devices") && hasValue) {expectedDevices = (size_t)atoi(argv[++i]);}
+        else if (!strcmp(argv[i], "--commands") && hasValue) {commandList = argv[++i];}
+        else if (!strcmp(argv[i], "--allow-dispense")) {allowDispense = true;}
+        else if (!strcmp(argv[i], "--window") && hasValue) {window = (size_t)atoi(argv[++i]);}
+        else if (!strcmp(argv[i], "--duration") && hasValue) {duration = atof(argv[++i]);}
+        else if (!strcmp(argv[i], "--timeout") && hasValue) {timeoutMs = atof(argv[++i]);}
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<std::string> commands;
+    for (size_t start = 0; start < commandList.size();) {
+        size_t end = commandList.find(',', start);
+        if (end == std::string::npos) {end = commandList.size();}
+        if (end > start) {commands.push_back(commandList.substr(start, end - start));}
+        start = end + 1;
+    }
+    if (commands.empty() || window == 0 || expectedDevices == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    for (const std::string &command : commands) {
+        if (!allowDispense && ReplyMatcher::dispenses(command)) {
+            fprintf(stderr, "[fleet_bench] \"%s\" dispenses, pass --allow-dispense to send it to every controller\n", command.c_str());
+            return 1;
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable replyCond;
+    FleetGateway gateway(root, "vmc-fleet-bench");
+    gateway.onReply([&](const std::string &, const std::string &) { replyCond.notify_all(); });
+    gateway.onStatus([&](const std::string &, bool) { replyCond.notify_all(); });
+    if (!gateway.connect(host, port)) {return 1;}
+
+    // Controllers are discovered from their retained status
+    auto online = [&gateway]() {
+        std::vector<std::string> ids;
+        for (const std::string &id : gateway.devices()) {
+            if (gateway.stats(id).online) {ids.push_back(id);}
+        }
+        return ids;
+    };
+    Clock::time_point discoveryEnd = Clock::now() + std::chrono::seconds(30);
+    std::vector<std::string> ids = online();
+    while (ids.size() < expectedDevices && Clock::now() < discoveryEnd) {
+        std::unique_lock<std::mutex> lock(mutex);
+        replyCond.wait_for(lock, std::chrono::milliseconds(100));
+        lock.unlock();
+        ids = online();
+    }
+    if (ids.size() < expectedDevices) {
+        fprintf(stderr, "[fleet_bench] Only %zu of %zu controllers online\n", ids.size(), expectedDevices);
+        return 1;
+    }
+    printf("[fleet_bench] %s:%d %zu controllers, commands \"%s\" window %zu duration %.0f s\n", host.c_str(), port, ids.size(),
+        commandList.c_str(), window, duration);
+    fflush(stdout);
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(duration));
+    auto timeout = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(timeoutMs));
+    std::vector<size_t> nextCommand(ids.size(), 0);
+
+    // Closed loop: every pass tops up each controller to its window, replies wake the next pass
+    while (Clock::now() < end) {
+        gateway.expire(timeout);
+        for (size_t i = 0; i < ids.size(); i++) {
+            for (size_t queued = gateway.queued(ids[i]); queued < window; queued++) {
+                gateway.send(ids[i], commands[nextCommand[i]++ % commands.size()]);
+            }
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        replyCond.wait_for(lock, std::chrono::milliseconds(5));
+    }
+
+    // Drain: wait for replies to what is still queued
+    Clock::time_point drainEnd = Clock::now() + timeout;
+    while (gateway.totals().outstanding + gateway.totals().backlog > 0 && Clock::now() < drainEnd) {
+        gateway.expire(timeout);
+        std::unique_lock<std::mutex> lock(mutex);
+        replyCond.wait_for(lock, std::chrono::milliseconds(10));
+    }
+    gateway.expireAll();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    gateway.disconnect();
+
+    // Fairness: Jain's index over per controller completions (1.0 = perfectly even) and the min/max spread
+    double sum = 0, sumSquares = 0;
+    uint64_t minCompleted = UINT64_MAX, maxCompleted = 0;
+    for (const std::string &id : ids) {
+        uint64_t completed = gateway.stats(id).completed;
+        sum += completed;
+        sumSquares += (double)completed * completed;
+        minCompleted = std::min(minCompleted, completed);
+        maxCompleted = std::max(maxCompleted, completed);
+    }
+    double fairness = sumSquares > 0 ? sum * sum / (ids.size() * sumSquares) : 0;
+
+    FleetGateway::DeviceStats totals = gateway.totals();
+    printf("controllers %zu\n", ids.size());
+    printf("sent        %llu\n", (unsigned long long)totals.sent);
+    printf("completed   %llu (%llu with ERROR/INVALID result)\n", (unsigned long long)totals.completed, (unsigned long long)totals.errors);
+    printf("throughput  %.2f cmd/s over %.1f s (%.2f cmd/s per controller)\n", totals.completed / elapsed, elapsed,
+        totals.completed / elapsed / ids.size());
+    printf("latency ms  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n", totals.latency.percentile(50), totals.latency.percentile(90),
+        totals.latency.percentile(99), totals.latency.max());
+    printf("drops       %llu (late replies %llu)\n", (unsigned long long)totals.drops, (unsigned long long)totals.late);
+    printf("duplicates  %llu\n", (unsigned long long)totals.duplicates);
+    printf("fairness    %.3f (completed per controller min %llu max %llu)\n", fairness, (unsigned long long)minCompleted,
+        (unsigned long long)maxCompleted);
+    printf("reconnects  %u\n", gateway.link().disconnects());
+
+    return totals.drops > 0 || totals.duplicates > 0 ? 2 : 0;
+}
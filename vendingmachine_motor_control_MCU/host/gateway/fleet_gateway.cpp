@@ -0,0 +1,250 @@
+#include "fleet_gateway.h"
+
+FleetGateway::FleetGateway(const std::string &root, const std::string &clientId) : root_(root), link_(clientId) {
+    link_.onMessage([this](const std::string &topic, const std::string &payload) { handleMessage(topic, payload); });
+    link_.subscribe(root_ + "/+/clientToHost");
+    link_.subscribe(root_ + "/+/status");
+}
+
+bool FleetGateway::connect(const std::string &host, int port) {
+    return link_.connect(host, port);
+}
+
+void FleetGateway::disconnect() {
+    link_.disconnect();
+}
+
+// Splits "<root>/<id>/<leaf>", returns false for other topics and reserved ids
+static bool splitTopic(const std::string &topic, const std::string &root, std::string &id, std::string &leaf) {
+    if (topic.compare(0, root.size() + 1, root + "/") != 0) {return false;}
+    size_t idStart = root.size() + 1;
+    size_t slash = topic.find('/', idStart);
+    if (slash == std::string::npos || slash == idStart) {return false;}
+    id = topic.substr(idStart, slash - idStart);
+    leaf = topic.substr(slash + 1);
+    return !FleetGateway::reservedId(id);
+}
+
+void FleetGateway::handleMessage(const std::string &topic, const std::string &payload) {
+    std::string id, leaf;
+    if (!splitTopic(topic, root_, id, leaf) || (leaf != "status" && leaf != "clientToHost")) {
+        if (otherHandler_) {otherHandler_(topic, payload);}
+        return;
+    }
+    Clock::time_point now = Clock::now();
+    std::vector<std::pair<std::string, std::string>> out;
+
+    if (leaf == "status") {
+        bool online = payload == "online";
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Device &device = devices_[id];
+            device.stats.online = online;
+            // Anything in flight to a controller that went offline will not be answered
+            if (!online) {
+                device.stats.drops += device.matcher.expireAll().size();
+                device.stats.drops += device.backlog.size();
+                device.backlog.clear();
+            }
+        }
+        if (statusHandler_) {statusHandler_(id, online);}
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Device &device = devices_[id];
+        device.stats.online = true; // Replying, even if its retained status has not arrived yet
+        ReplyMatcher::Match match = device.matcher.match(payload);
+        switch (match.kind) {
+            case ReplyMatcher::Kind::Informational:
+                break;
+            case ReplyMatcher::Kind::Late:
+                device.stats.late += 1;
+                break;
+            case ReplyMatcher::Kind::Duplicate:
+                device.stats.duplicates += 1;
+                break;
+            case ReplyMatcher::Kind::Completed:
+                device.stats.completed += 1;
+                if (match.error) {device.stats.errors += 1;}
+                device.stats.latency.add(std::chrono::duration<double, std::milli>(now - match.request.sent).count());
+                pumpLocked(id, device, out);
+                break;
+        }
+    }
+    flush(out);
+    if (replyHandler_) {replyHandler_(id, payload);}
+}
+
+// Records the request and queues the publish, publishing happens after the lock is released
+void FleetGateway::publishLocked(const std::string &id, Device &device, const std::string &command, std::vector<std::pair<std::string, std::string>> &out) {
+    device.matcher.add({nextId_++, ReplyMatcher::actionOf(command), Clock::now(), link_.disconnects()});
+    device.stats.sent += 1;
+    out.emplace_back(root_ + "/" + id + "/hostToClient", command);
+}
+
+void FleetGateway::pumpLocked(const std::string &id, Device &device, std::vector<std::pair<std::string, std::string>> &out) {
+    while (!device.backlog.empty() && device.matcher.outstanding() < FLEET_DEVICE_WINDOW) {
+        publishLocked(id, device, device.backlog.front(), out);
+        device.backlog.pop_front();
+    }
+}
+
+void FleetGateway::flush(const std::vector<std::pair<std::string, std::string>> &out) {
+    for (const auto &message : out) {link_.publish(message.first, message.second);}
+}
+
+bool FleetGateway::send(const std::string &id, const std::string &command) {
+    if (reservedId(id)) {return false;}
+    std::vector<std::pair<std::string, std::string>> out;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Device &device = devices_[id];
+        if (device.backlog.size() >= FLEET_DEVICE_BACKLOG) {
+            device.stats.rejected += 1;
+            return false;
+        }
+        device.backlog.push_back(command);
+        pumpLocked(id, device, out);
+    }
+    flush(out);
+    return true;
+}
+
+size_t FleetGateway::broadcast(const std::string &command) {
+    size_t expected = 0;
+    {
+        // Every online controller receives it straight away, so it bypasses the per device window
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string action = ReplyMatcher::actionOf(command);
+        for (auto &entry : devices_) {
+            Device &device = entry.second;
+            if (!device.stats.online) {continue;}
+            device.matcher.add({nextId_++, action, Clock::now(), link_.disconnects()});
+            device.stats.sent += 1;
+            expected += 1;
+        }
+    }
+    link_.publish(root_ + "/all/hostToClient", command);
+    return expected;
+}
+
+size_t FleetGateway::expire(Clock::duration timeout) {
+    size_t expired = 0;
+    std::vector<std::pair<std::string, std::string>> out;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Clock::time_point now = Clock::now();
+        for (auto &entry : devices_) {
+            size_t count = entry.second.matcher.expire(now, timeout).size();
+            if (count == 0) {continue;}
+            entry.second.stats.drops += count;
+            expired += count;
+            pumpLocked(entry.first, entry.second, out);
+        }
+    }
+    flush(out);
+    return expired;
+}
+
+size_t FleetGateway::expireAll() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t expired = 0;
+    for (auto &entry : devices_) {
+        size_t count = entry.second.matcher.expireAll().size() + entry.second.backlog.size();
+        entry.second.backlog.clear();
+        entry.second.stats.drops += count;
+        expired += count;
+    }
+    return expired;
+}
+
+std::vector<std::string> FleetGateway::devices() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> ids;
+    for (const auto &entry : devices_) {ids.push_back(entry.first);}
+    return ids;
+}
+
+size_t FleetGateway::queued(const std::string &id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto device = devices_.find(id);
+    return device == devices_.end() ? 0 : device->second.matcher.outstanding() + device->second.backlog.size();
+}
+
+FleetGateway::DeviceStats FleetGateway::stats(const std::string &id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto device = devices_.find(id);
+    if (device == devices_.end()) {return DeviceStats();}
+    DeviceStats stats = device->second.stats;
+    stats.outstanding = device->second.matcher.outstanding();
+    stats.backlog = device->second.backlog.size();
+    return stats;
+}
+
+void FleetGateway::addStats(DeviceStats &sum, const DeviceStats &stats) {
+    sum.online = sum.online || stats.online;
+    sum.sent += stats.sent;
+    sum.completed += stats.completed;
+    sum.errors += stats.errors;
+    sum.drops += stats.drops;
+    sum.late += stats.late;
+    sum.duplicates += stats.duplicates;
+    sum.rejected += stats.rejected;
+    sum.outstanding += stats.outstanding;
+    sum.backlog += stats.backlog;
+    sum.latency.merge(stats.latency);
+}
+
+FleetGateway::DeviceStats FleetGateway::totals() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    DeviceStats sum;
+    for (const auto &entry : devices_) {
+        DeviceStats stats = entry.second.stats;
+        stats.outstanding = entry.second.matcher.outstanding();
+        stats.backlog = entry.second.backlog.size();
+        addStats(sum, stats);
+    }
+    return sum;
+}
+
+std::string FleetGateway::summaryJson() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    DeviceStats sum;
+    size_t online = 0;
+    std::string offlineIds;
+    for (const auto &entry : devices_) {
+        DeviceStats stats = entry.second.stats;
+        stats.outstanding = entry.second.matcher.outstanding();
+        stats.backlog = entry.second.backlog.size();
+        addStats(sum, stats);
+        if (stats.online) {
+            online += 1;
+        } else {
+            offlineIds += (offlineIds.empty() ? "\"" : ",\"") + entry.first + "\"";
+        }
+    }
+    char json[512];
+    snprintf(json, sizeof(json),
+        "{\"devices\":%zu,\"online\":%zu,\"sent\":%llu,\"completed\":%llu,\"errors\":%llu,\"drops\":%llu,\"late\":%llu,"
+        "\"duplicates\":%llu,\"rejected\":%llu,\"outstanding\":%zu,\"backlog\":%zu,\"p50_ms\":%.1f,\"p99_ms\":%.1f,\"max_ms\":%.1f,\"offline\":[",
+        devices_.size(), online, (unsigned long long)sum.sent, (unsigned long long)sum.completed, (unsigned long long)sum.errors,
+        (unsigned long long)sum.drops, (unsigned long long)sum.late, (unsigned long long)sum.duplicates, (unsigned long long)sum.rejected,
+        sum.outstanding, sum.backlog, sum.latency.percentile(50), sum.latency.percentile(99), sum.latency.max());
+    return std::string(json) + offlineIds + "]}";
+}
+
+void FleetGateway::printTable(FILE *out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fprintf(out, "%-14s %-7s %8s %9s %6s %6s %5s %5s %7s %8s %8s\n", "device", "status", "sent", "completed", "errors", "drops",
+        "late", "dup", "queued", "p50 ms", "p99 ms");
+    for (const auto &entry : devices_) {
+        const Device &device = entry.second;
+        const DeviceStats &stats = device.stats;
+        fprintf(out, "%-14s %-7s %8llu %9llu %6llu %6llu %5llu %5llu %7zu %8.1f %8.1f\n", entry.first.c_str(),
+            stats.online ? "online" : "offline", (unsigned long long)stats.sent, (unsigned long long)stats.completed,
+            (unsigned long long)stats.errors, (unsigned long long)stats.drops, (unsigned long long)stats.late,
+            (unsigned long long)stats.duplicates, device.matcher.outstanding() + device.backlog.size(),
+            stats.latency.percentile(50), stats.latency.percentile(99));
+    }
+}
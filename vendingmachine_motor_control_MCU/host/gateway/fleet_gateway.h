@@ -0,0 +1,103 @@
+#ifndef FLEET_GATEWAY_H
+#define FLEET_GATEWAY_H
+
+#include "latency_histogram.h"
+#include "mqtt_link.h"
+#include "reply_matcher.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Mirrors COMMAND_QUEUE_LEN in include/command_handling.h: commands published to a controller at once (queue + executing)
+#define FLEET_DEVICE_WINDOW 5
+// Commands held by the gateway per controller while its window is full, send() fails beyond this
+#define FLEET_DEVICE_BACKLOG 64
+
+/*
+Host-side gateway for a fleet of controllers on one broker
+Subscribes to <root>/+/clientToHost and <root>/+/status, discovers controllers from their retained status,
+routes commands to <root>/<id>/hostToClient and keeps per controller request matching and metrics
+Publishes at most FLEET_DEVICE_WINDOW commands to a controller at a time and holds the rest, so one busy controller
+never overflows its firmware command queue or holds up the others
+Thread safe, handlers are called from the network thread without the gateway lock held
+*/
+class FleetGateway {
+public:
+    using Clock = ReplyMatcher::Clock;
+    using ReplyHandler = std::function<void(const std::string &device, const std::string &reply)>;
+
+    struct DeviceStats {
+        bool online = false;
+        uint64_t sent = 0; // Published to the controller
+        uint64_t completed = 0;
+        uint64_t errors = 0; // Completions reporting an ERROR/INVALID result
+        uint64_t drops = 0; // No reply within timeout
+        uint64_t late = 0;
+        uint64_t duplicates = 0;
+        uint64_t rejected = 0; // send() refused, backlog full
+        size_t outstanding = 0;
+        size_t backlog = 0;
+        LatencyHistogram latency; // ms from publish to reply
+    };
+
+    explicit FleetGateway(const std::string &root = "vmc", const std::string &clientId = "vmc-gateway");
+
+    FleetGateway(const FleetGateway &) = delete;
+    FleetGateway &operator=(const FleetGateway &) = delete;
+
+    bool connect(const std::string &host, int port);
+    void disconnect();
+    bool connected() const { return link_.connected(); }
+
+    bool send(const std::string &device, const std::string &command); // False if the device's backlog is full
+    size_t broadcast(const std::string &command); // One publish on <root>/all/hostToClient, returns online devices expected to reply
+    size_t expire(Clock::duration timeout); // Counts requests without a reply within timeout as dropped, returns count
+    size_t expireAll();
+
+    std::vector<std::string> devices() const;
+    size_t queued(const std::string &device) const; // Outstanding + held in the gateway
+    DeviceStats stats(const std::string &device) const;
+    DeviceStats totals() const; // Summed over the fleet (online = any device online)
+
+    std::string summaryJson() const;
+    void printTable(FILE *out) const;
+
+    void onReply(ReplyHandler handler) { replyHandler_ = std::move(handler); }
+    void onStatus(std::function<void(const std::string &device, bool online)> handler) { statusHandler_ = std::move(handler); }
+    void onOther(MqttLink::MessageHandler handler) { otherHandler_ = std::move(handler); } // Messages on extra link() subscriptions
+
+    MqttLink &link() { return link_; }
+    const std::string &root() const { return root_; }
+
+    static bool reservedId(const std::string &id) { return id == "all" || id == "gateway"; }
+
+private:
+    struct Device {
+        DeviceStats stats;
+        ReplyMatcher matcher;
+        std::deque<std::string> backlog;
+    };
+
+    void handleMessage(const std::string &topic, const std::string &payload);
+    void publishLocked(const std::string &id, Device &device, const std::string &command, std::vector<std::pair<std::string, std::string>> &out);
+    void pumpLocked(const std::string &id, Device &device, std::vector<std::pair<std::string, std::string>> &out);
+    void flush(const std::vector<std::pair<std::string, std::string>> &out);
+    static void addStats(DeviceStats &sum, const DeviceStats &stats);
+
+    std::string root_;
+    MqttLink link_;
+    mutable std::mutex mutex_;
+    std::map<std::string, Device> devices_; // Ordered by id for stable tables
+    uint64_t nextId_ = 0;
+    ReplyHandler replyHandler_;
+    std::function<void(const std::string &, bool)> statusHandler_;
+    MqttLink::MessageHandler otherHandler_;
+};
+
+#endif
@@ -0,0 +1,139 @@
+/*
+Fleet gateway: routes commands to controllers on one broker and aggregates their status
+Commands are read from stdin and from <root>/gateway/command, one per line/message:
+  <device id> <command>   eg. "a4cf12b3c4d5 disp;a1"
+  all <command>           broadcast to every controller
+  devices                 list known controllers
+  status                  per controller table
+Replies are printed as "<device id> <reply>", a retained JSON fleet summary is published to <root>/gateway/fleet
+*/
+#include "fleet_gateway.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+static volatile std::sig_atomic_t running = 1;
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --host <addr>          MQTT broker host (default 127.0.0.1)\n"
+        "  --port <port>          MQTT broker port (default 1884, see mosquitto.conf)\n"
+        "  --root <topic>         MQTT topic root (default vmc, MQTT_TOPIC_ROOT in include/global.h)\n"
+        "  --timeout <ms>         Reply timeout before a command counts as dropped (default 30000)\n"
+        "  --summary-interval <s> Fleet summary publish interval (default 10)\n"
+        "  --quiet                Don't print replies\n", argv0);
+}
+
+static std::mutex outputMutex;
+
+static void handleLine(FleetGateway &gateway, const std::string &line) {
+    std::string trimmed = line;
+    while (!trimmed.empty() && (trimmed.back() == '\n' || trimmed.back() == '\r' || trimmed.back() == ' ')) {trimmed.pop_back();}
+    if (trimmed.empty()) {return;}
+
+    std::lock_guard<std::mutex> lock(outputMutex);
+    if (trimmed == "devices") {
+        for (const std::string &id : gateway.devices()) {
+            printf("%s %s\n", id.c_str(), gateway.stats(id).online ? "online" : "offline");
+        }
+        return;
+    }
+    if (trimmed == "status") {
+        gateway.printTable(stdout);
+        printf("%s\n", gateway.summaryJson().c_str());
+        return;
+    }
+    size_t space = trimmed.find(' ');
+    if (space == std::string::npos || space == 0 || space + 1 == trimmed.size()) {
+        printf("gateway INVALID \"%s\", expected \"<device|all> <command>\", \"devices\" or \"status\"\n", trimmed.c_str());
+        return;
+    }
+    std::string target = trimmed.substr(0, space);
+    std::string command = trimmed.substr(space + 1);
+    if (target == "all") {
+        printf("gateway SENT %s to %zu online device(s)\n", command.c_str(), gateway.broadcast(command));
+    } else if (!gateway.send(target, command)) {
+        printf("gateway ERROR %s backlog full or reserved id\n", target.c_str());
+    }
+}
+
+int main(int argc, char **argv) {
+    std::string host = "127.0.0.1";
+    int port = 1884;
+    std::string root = "vmc";
+    double timeoutMs = 30000;
+    double summaryInterval = 10;
+    bool quiet = false;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--host") && hasValue) {host = argv[++i];}
+        else if (!strcmp(argv[i], "--port") && hasValue) {port = atoi(argv[++i]);}
+        else if (!strcmp(argv[i], "--root") && hasValue) {root = argv[++i];}
+        else if (!strcmp(argv[i], "--timeout") && hasValue) {timeoutMs = atof(argv[++i]);}
+        else if (!strcmp(argv[i], "--summary-interval") && hasValue) {summaryInterval = atof(argv[++i]);}
+        else if (!strcmp(argv[i], "--quiet")) {quiet = true;}
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    FleetGateway gateway(root);
+    const std::string commandTopic = root + "/gateway/command";
+    const std::string summaryTopic = root + "/gateway/fleet";
+
+    gateway.onReply([quiet](const std::string &id, const std::string &reply) {
+        if (quiet) {return;}
+        std::lock_guard<std::mutex> lock(outputMutex);
+        printf("%s %s\n", id.c_str(), reply.c_str());
+        fflush(stdout);
+    });
+    gateway.onStatus([](const std::string &id, bool online) {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        printf("%s %s\n", id.c_str(), online ? "ONLINE" : "OFFLINE");
+        fflush(stdout);
+    });
+    // The gateway's own command topic shares its broker connection
+    MqttLink &link = gateway.link();
+    link.subscribe(commandTopic);
+    gateway.onOther([&gateway, &commandTopic](const std::string &topic, const std::string &payload) {
+        if (topic == commandTopic) {handleLine(gateway, payload);}
+    });
+    if (!gateway.connect(host, port)) {return 1;}
+    while (!gateway.connected()) {std::this_thread::sleep_for(std::chrono::milliseconds(10));}
+
+    std::signal(SIGINT, [](int) { running = 0; });
+    std::signal(SIGTERM, [](int) { running = 0; });
+    printf("[fleet_gateway] %s:%d root %s, commands on stdin and %s, summary on %s\n", host.c_str(), port, root.c_str(),
+        commandTopic.c_str(), summaryTopic.c_str());
+    fflush(stdout);
+
+    // stdin is read on its own thread, the gateway keeps serving MQTT after stdin closes
+    std::thread([&gateway]() {
+        std::string line;
+        while (std::getline(std::cin, line)) {handleLine(gateway, line);}
+    }).detach();
+
+    auto timeout = std::chrono::duration_cast<FleetGateway::Clock::duration>(std::chrono::duration<double, std::milli>(timeoutMs));
+    auto interval = std::chrono::duration_cast<FleetGateway::Clock::duration>(std::chrono::duration<double>(summaryInterval));
+    FleetGateway::Clock::time_point nextSummary = FleetGateway::Clock::now();
+    while (running) {
+        gateway.expire(timeout);
+        if (FleetGateway::Clock::now() >= nextSummary) {
+            link.publish(summaryTopic, gateway.summaryJson(), true);
+            nextSummary += interval;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    gateway.disconnect();
+    return 0;
+}
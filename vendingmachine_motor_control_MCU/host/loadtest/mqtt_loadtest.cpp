@@ -0,0 +1,290 @@
+/*
+MQTT load/soak test for the motor controller (real device or sim/firmware_sim)
+Replays a weighted command mix on the command topic at a controlled rate, correlates replies on the response topic and
+reports throughput, latency percentiles, drops (no reply within timeout), late and duplicate replies, and broker reconnects
+
+Replies are correlated to requests by ReplyMatcher (oldest outstanding request of the same action)
+*/
+#include "mqtt_link.h"
+#include "reply_matcher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using Clock = ReplyMatcher::Clock;
+
+struct MixEntry {
+    std::string command;
+    std::string action;
+    double weight;
+};
+
+struct HeapSample {
+    double t; // s since start
+    unsigned int free;
+    unsigned int largest;
+    bool simulated; // firmware_sim process heap, not a firmware measurement
+};
+
+struct Results {
+    uint64_t sent = 0;
+    uint64_t completed = 0;
+    uint64_t errors = 0; // Completions reporting an ERROR/INVALID result
+    uint64_t drops = 0; // No reply within timeout
+    uint64_t late = 0; // Reply arrived after its request was counted as dropped
+    uint64_t duplicates = 0; // Reply with no matching request
+    std::vector<double> latencies; // ms
+    std::vector<double> reconnectLatencies; // ms, requests that spanned a broker reconnect
+    std::vector<HeapSample> heap; // Replies to heap probes
+};
+
+// Parses "disp;a1=8,stop;=1" into weighted mix entries
+static bool parseMix(const std::string &spec, std::vector<MixEntry> &mix) {
+    size_t start = 0;
+    while (start < spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos) {end = spec.size();}
+        std::string item = spec.substr(start, end - start);
+        size_t equals = item.rfind('=');
+        MixEntry entry;
+        entry.command = item.substr(0, equals);
+        entry.weight = equals == std::string::npos ? 1.0 : atof(item.c_str() + equals + 1);
+        entry.action = ReplyMatcher::actionOf(entry.command);
+        if (entry.command.find(';') == std::string::npos || entry.weight <= 0) {return false;}
+        mix.push_back(entry);
+        start = end + 1;
+    }
+    return !mix.empty();
+}
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {return 0;}
+    std::sort(values.begin(), values.end());
+    size_t idx = (size_t)(p / 100.0 * (values.size() - 1) + 0.5);
+    return values[idx];
+}
+
+// Least squares slope of free heap over time in bytes/hour
+static double heapSlope(const std::vector<HeapSample> &samples) {
+    if (samples.size() < 2) {return 0;}
+    double meanT = 0, meanFree = 0;
+    for (const HeapSample &s : samples) {
+        meanT += s.t / samples.size();
+        meanFree += (double)s.free / samples.size();
+    }
+    double num = 0, den = 0;
+    for (const HeapSample &s : samples) {
+        num += (s.t - meanT) * (s.free - meanFree);
+        den += (s.t - meanT) * (s.t - meanT);
+    }
+    return den > 0 ? num / den * 3600.0 : 0;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --host <addr>        MQTT broker host (default 127.0.0.1)\n"
+        "  --port <port>        MQTT broker port (default 1884, see mosquitto.conf)\n"
+        "  --device <id>        Controller device id, see MQTT DEVICE at boot (default sim0000, the first firmware_sim device)\n"
+        "  --root <topic>       MQTT topic root (default vmc, MQTT_TOPIC_ROOT in include/global.h)\n"
+        "  --mix <spec>         Weighted command mix (default \"stats;a1=1,idle;=1\", nothing dispensed), eg. \"stats;a1=8,test;a1=1,stop;=1\"\n"
+        "  --allow-dispense     Allow disp/mdisp/vend in --mix, each one gives away a product on a real controller\n"
+        "  --rate <cmd/s>       Target send rate, 0 = as fast as the window allows (default 0)\n"
+        "  --window <n>         Max outstanding commands (default 5: firmware queue of 4 + 1 executing)\n"
+        "  --duration <s>       Send duration (default 60)\n"
+        "  --timeout <ms>       Reply timeout before a command counts as dropped (default 30000)\n"
+        "  --seed <n>           Random seed for the mix (default 1)\n"
+        "  --heap-interval <s>  Probe heap telemetry (heap;) every <s> seconds, 0 = off (default 0)\n"
+        "  --heap-warmup <s>    Ignore heap probes of the first <s> seconds while buffers settle (default 10)\n"
+        "  --heap-tolerance <b> Max change of free heap / largest block between first and last probe (default 1024)\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    std::string host = "127.0.0.1";
+    int port = 1884;
+    std::string device = "sim0000";
+    std::string root = "vmc";
+    std::string mixSpec = "stats;a1=1,idle;=1";
+    bool allowDispense = false;
+    double rate = 0;
+    size_t window = 5;
+    double duration = 60;
+    double timeoutMs = 30000;
+    unsigned seed = 1;
+    double heapInterval = 0;
+    double heapWarmup = 10;
+    double heapTolerance = 1024;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--host") && hasValue) {host = argv[++i];}
+        else if (!strcmp(argv[i], "--port") && hasValue) {port = atoi(argv[++i]);}
+        else if (!strcmp(argv[i], "--device") && hasValue) {device = argv[++i];}
+        else if (!strcmp(argv[i], "--root") && hasValue) {root = argv[++i];}
+        else if (!strcmp(argv[i], "--mix") && hasValue) {mixSpec = argv[++i];}
+        else if (!strcmp(argv[i], "--allow-dispense")) {allowDispense = true;}
+        else if (!strcmp(argv[i], "--rate") && hasValue) {rate = atof(argv[++i]);}
+        else if (!strcmp(argv[i], "--window") && hasValue) {window = (size_t)atoi(argv[++i]);}
+        else if (!strcmp(argv[i], "--duration") && hasValue) {duration = atof(argv[++i]);}
+        else if (!strcmp(argv[i], "--timeout") && hasValue) {timeoutMs = atof(argv[++i]);}
+        else if (!strcmp(argv[i], "--seed") && hasValue) {seed = (unsigned)atoi(argv[++i]);}
+        else if (!strcmp(argv[i], "--heap-interval") && hasValue) {heapInterval = atof(argv[++i]);}
+        else if (!strcmp(argv[i], "--heap-warmup") && hasValue) {heapWarmup = atof(argv[++i]);}
+        else if (!strcmp(argv[i], "--heap-tolerance") && hasValue) {heapTolerance = atof(argv[++i]);}
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<MixEntry> mix;
+    if (!parseMix(mixSpec, mix) || window == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    for (const MixEntry &entry : mix) {
+        if (!allowDispense && ReplyMatcher::dispenses(entry.command)) {
+            fprintf(stderr, "[mqtt_loadtest] \"%s\" dispenses, pass --allow-dispense to load test it\n", entry.command.c_str());
+            return 1;
+        }
+    }
+    std::vector<double> weights;
+    for (const MixEntry &entry : mix) {weights.push_back(entry.weight);}
+    std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+    std::mt19937 rng(seed);
+
+    const std::string incomingTopic = root + "/" + device + "/hostToClient";
+    const std::string outgoingTopic = root + "/" + device + "/clientToHost";
+
+    std::mutex mutex;
+    std::condition_variable replyCond;
+    ReplyMatcher matcher; // Request tag is the link disconnect count when sent, a change means the request spanned a reconnect
+    Results results;
+
+    Clock::time_point start = Clock::now();
+    MqttLink link("vmc-loadtest-" + std::to_string(getpid())); // Per run, a broker drops the older of two clients with the same id
+    link.onMessage([&](const std::string &topic, const std::string &payload) {
+        if (topic != outgoingTopic) {return;}
+        Clock::time_point now = Clock::now();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        ReplyMatcher::Match match = matcher.match(payload);
+        switch (match.kind) {
+            case ReplyMatcher::Kind::Informational:
+                return;
+            case ReplyMatcher::Kind::Late:
+                results.late += 1;
+                return;
+            case ReplyMatcher::Kind::Duplicate:
+                results.duplicates += 1;
+                return;
+            case ReplyMatcher::Kind::Completed:
+                break;
+        }
+        double latency = std::chrono::duration<double, std::milli>(now - match.request.sent).count();
+        results.latencies.push_back(latency);
+        if (match.request.tag != link.disconnects()) {results.reconnectLatencies.push_back(latency);}
+        results.completed += 1;
+        if (match.error) {results.errors += 1;}
+
+        HeapSample sample;
+        if (match.request.action == "heap" && sscanf(payload.c_str(), "heap DONE FREE %u MIN %*u LARGEST %u", &sample.free, &sample.largest) == 2) {
+            sample.simulated = payload.find(" SIMULATED") != std::string::npos;
+            sample.t = std::chrono::duration<double>(now - start).count();
+            if (sample.t >= heapWarmup) {results.heap.push_back(sample);}
+        }
+        replyCond.notify_all();
+    });
+    link.subscribe(outgoingTopic);
+    if (!link.connect(host, port)) {return 1;}
+    while (!link.connected()) {std::this_thread::sleep_for(std::chrono::milliseconds(10));}
+
+    char rateText[16] = "max";
+    if (rate > 0) {snprintf(rateText, sizeof(rateText), "%.1f/s", rate);}
+    printf("[mqtt_loadtest] %s:%d device %s mix \"%s\" rate %s window %zu duration %.0f s\n", host.c_str(), port, device.c_str(), mixSpec.c_str(),
+        rateText, window, duration);
+
+    start = Clock::now();
+    Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(duration));
+    Clock::time_point nextSend = start;
+    Clock::time_point nextHeapProbe = start;
+    auto timeout = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(timeoutMs));
+    uint64_t nextId = 0;
+
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (Clock::now() < end) {
+        results.drops += matcher.expire(Clock::now(), timeout).size();
+        if (matcher.outstanding() >= window) {
+            replyCond.wait_for(lock, std::chrono::milliseconds(10));
+            continue;
+        }
+        if (rate > 0 && Clock::now() < nextSend) {
+            replyCond.wait_until(lock, std::min(nextSend, end));
+            continue;
+        }
+        // Heap probes take the place of a mix command so they don't change the offered load
+        bool heapProbe = heapInterval > 0 && Clock::now() >= nextHeapProbe;
+        const MixEntry &entry = mix[pick(rng)];
+        std::string command = heapProbe ? "heap;" : entry.command;
+        matcher.add({nextId++, heapProbe ? "heap" : entry.action, Clock::now(), link.disconnects()});
+        results.sent += 1;
+        lock.unlock();
+        link.publish(incomingTopic, command);
+        lock.lock();
+        if (heapProbe) {nextHeapProbe += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(heapInterval));}
+        if (rate > 0) {nextSend += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate));}
+    }
+
+    // Drain: wait for replies to what is still outstanding
+    Clock::time_point drainEnd = Clock::now() + timeout;
+    while (matcher.outstanding() > 0 && Clock::now() < drainEnd) {
+        replyCond.wait_for(lock, std::chrono::milliseconds(10));
+    }
+    results.drops += matcher.expireAll().size();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    lock.unlock();
+    link.disconnect();
+
+    printf("sent        %llu\n", (unsigned long long)results.sent);
+    printf("completed   %llu (%llu with ERROR/INVALID result)\n", (unsigned long long)results.completed, (unsigned long long)results.errors);
+    printf("throughput  %.2f cmd/s over %.1f s\n", results.completed / elapsed, elapsed);
+    printf("latency ms  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n", percentile(results.latencies, 50),
+        percentile(results.latencies, 90), percentile(results.latencies, 99), percentile(results.latencies, 100));
+    printf("drops       %llu (late replies %llu)\n", (unsigned long long)results.drops, (unsigned long long)results.late);
+    printf("duplicates  %llu\n", (unsigned long long)results.duplicates);
+    printf("reconnects  %u", link.disconnects());
+    if (!results.reconnectLatencies.empty()) {
+        printf(" (%zu requests spanned a reconnect: p50 %.1f  p99 %.1f ms)", results.reconnectLatencies.size(),
+            percentile(results.reconnectLatencies, 50), percentile(results.reconnectLatencies, 99));
+    }
+    printf("\n");
+
+    bool heapFlat = true;
+    if (!results.heap.empty()) {
+        const HeapSample &first = results.heap.front();
+        const HeapSample &last = results.heap.back();
+        unsigned int minLargest = first.largest;
+        for (const HeapSample &sample : results.heap) {minLargest = std::min(minLargest, sample.largest);}
+        heapFlat = fabs((double)last.free - first.free) <= heapTolerance && fabs((double)last.largest - first.largest) <= heapTolerance;
+        // A simulated controller only exercises the probes and this summary, it says nothing about the firmware heap
+        const char *verdict = last.simulated ? "SIMULATED (no firmware verdict, soak a real controller)" : (heapFlat ? "FLAT" : "DRIFTING");
+        printf("heap        %zu probes  FREE %u -> %u (%+.0f B/h)  LARGEST %u -> %u (min %u)  %s\n", results.heap.size(),
+            first.free, last.free, heapSlope(results.heap), first.largest, last.largest, minLargest, verdict);
+        if (last.simulated) {heapFlat = true;}
+    }
+
+    if (results.drops > 0 || results.duplicates > 0) {return 2;}
+    return heapFlat ? 0 : 3;
+}
@@ -0,0 +1,209 @@
+/*
+Simulated motor controller firmware on a local MQTT broker (or a pseudo terminal with --pty)
+Each simulated controller connects like the firmware (own client ID, retained online/offline status with will) and
+replies on its own response topic exactly like the firmware, so host tools (eg. loadtest/mqtt_loadtest,
+gateway/fleet_bench) can be exercised without hardware
+*/
+#include "mqtt_link.h"
+#include "sim_device.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+static volatile std::sig_atomic_t running = 1;
+
+// One simulated controller and its broker connection
+struct SimController {
+    std::string id;
+    std::unique_ptr<MqttLink> link;
+    std::unique_ptr<SimDevice> device;
+};
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --host <addr>        MQTT broker host (default 127.0.0.1)\n"
+        "  --port <port>        MQTT broker port (default 1884, see mosquitto.conf)\n"
+        "  --devices <n>        Number of simulated controllers, one broker connection each (default 1)\n"
+        "  --id-prefix <s>      Device ids are <prefix><4 digit index> (default sim)\n"
+        "  --root <topic>       MQTT topic root (default vmc, MQTT_TOPIC_ROOT in include/global.h)\n"
+        "  --time-scale <x>     Multiplier on simulated motor timing (default 1.0, 0 = instant)\n"
+        "  --fail-rate <p>      Probability of a dispense home timeout (default 0)\n"
+        "  --seed <n>           Random seed (default 1)\n"
+        "  --pty                Simulate one controller on a pseudo terminal instead of MQTT (Serial framing, acks and\n"
+        "                       the send; row handshake), prints the terminal's path\n", argv0);
+}
+
+// Writes one line like Serial.println
+static void writeLine(int fd, std::mutex &mutex, const std::string &line) {
+    std::string out = line + "\r\n";
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t written = 0;
+    while (written < out.size()) {
+        ssize_t n = write(fd, out.data() + written, out.size() - written);
+        if (n <= 0) {return;}
+        written += (size_t)n;
+    }
+}
+
+/*
+Serves one simulated controller on a pseudo terminal, framing lines like serialHandler: every line is acknowledged with
+RECEIVE SUCCESS (or RECEIVE FAIL if empty/overlong) except rowreceived confirmations
+*/
+static int runPty(const SimOptions &baseOptions) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        perror("[firmware_sim] posix_openpt");
+        return 1;
+    }
+    std::string path = ptsname(master);
+    // Hold the terminal side open in raw mode so nothing is echoed or line buffered before a client opens it
+    int slave = open(path.c_str(), O_RDWR | O_NOCTTY);
+    struct termios tty;
+    if (slave < 0 || tcgetattr(slave, &tty) != 0) {
+        perror("[firmware_sim] pty");
+        return 1;
+    }
+    cfmakeraw(&tty);
+    tcsetattr(slave, TCSANOW, &tty);
+
+    std::mutex writeMutex;
+    SimOptions options = baseOptions;
+    options.serial = true;
+    SimDevice device(options, [master, &writeMutex](const std::string &response) { writeLine(master, writeMutex, response); });
+
+    printf("[firmware_sim] Simulating controller on %s (time scale %.3f)\n", path.c_str(), options.timeScale);
+    fflush(stdout);
+    writeLine(master, writeMutex, "MotorControl Ready");
+
+    std::string line;
+    bool overflow = false;
+    char buffer[256];
+    while (running) {
+        struct pollfd pfd = {master, POLLIN, 0};
+        if (poll(&pfd, 1, 100) <= 0) {continue;}
+        ssize_t n = read(master, buffer, sizeof(buffer));
+        for (ssize_t i = 0; i < n; i++) {
+            char c = buffer[i];
+            if (c == '\r') {continue;}
+            if (c != '\n') {
+                if (line.size() >= SIM_COMMAND_MAX_LEN - 1) {overflow = true;}
+                else {line += c;}
+                continue;
+            }
+            if (overflow || line.empty()) {
+                writeLine(master, writeMutex, "RECEIVE FAIL");
+            } else if (line.compare(0, 11, "rowreceived") == 0) {
+                device.submit(line);
+            } else {
+                device.submit(line);
+                writeLine(master, writeMutex, "RECEIVE SUCCESS");
+            }
+            line.clear();
+            overflow = false;
+        }
+    }
+    close(slave);
+    close(master);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    std::string host = "127.0.0.1";
+    int port = 1884;
+    int devices = 1;
+    std::string idPrefix = "sim";
+    std::string root = "vmc";
+    SimOptions options;
+    bool pty = false;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--host") && hasValue) {host = argv[++i];}
+        else if (!strcmp(argv[i], "--port") && hasValue) {port = atoi(argv[++i]);}
+        else if (!strcmp(argv[i], "--devices") && hasValue) {devices = atoi(argv[++i]);}
+        else if (!strcmp(argv[i], "--id-prefix") && hasValue) {idPrefix = argv[++i];}
+        else if (!strcmp(argv[i], "--root") && hasValue) {root = argv[++i];}
+        else if (!strcmp(argv[i], "--time-scale") && hasValue) {options.timeScale = atof(argv[++i]);}
+        else if (!strcmp(argv[i], "--fail-rate") && hasValue) {options.failRate = atof(argv[++i]);}
+        else if (!strcmp(argv[i], "--seed") && hasValue) {options.seed = (unsigned)atoi(argv[++i]);}
+        else if (!strcmp(argv[i], "--pty")) {pty = true;}
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (devices < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (pty) {
+        std::signal(SIGINT, [](int) { running = 0; });
+        std::signal(SIGTERM, [](int) { running = 0; });
+        return runPty(options);
+    }
+
+    const std::string broadcastTopic = root + "/all/hostToClient";
+    std::vector<SimController> controllers(devices);
+    for (int i = 0; i < devices; i++) {
+        SimController &controller = controllers[i];
+        char id[32];
+        snprintf(id, sizeof(id), "%s%04d", idPrefix.c_str(), i);
+        controller.id = id;
+        const std::string incomingTopic = root + "/" + controller.id + "/hostToClient";
+        const std::string outgoingTopic = root + "/" + controller.id + "/clientToHost";
+        const std::string statusTopic = root + "/" + controller.id + "/status";
+
+        controller.link.reset(new MqttLink("vmc-" + controller.id));
+        MqttLink *link = controller.link.get();
+        SimOptions deviceOptions = options;
+        deviceOptions.seed = options.seed + i;
+        controller.device.reset(new SimDevice(deviceOptions, [link, outgoingTopic](const std::string &response) {
+            link->publish(outgoingTopic, response);
+        }));
+        SimDevice *device = controller.device.get();
+
+        link->setWill(statusTopic, "offline");
+        link->onConnection([link, statusTopic](bool connected) {
+            if (connected) {link->publish(statusTopic, "online", true);}
+        });
+        link->onMessage([device, incomingTopic, broadcastTopic](const std::string &topic, const std::string &payload) {
+            if (topic != incomingTopic && topic != broadcastTopic) {return;}
+            std::string command = payload;
+            while (!command.empty() && (command.back() == '\n' || command.back() == '\r')) {command.pop_back();}
+            if (!device->submit(command)) {
+                fprintf(stderr, "[firmware_sim] Command length invalid, discarding input\n");
+            }
+        });
+        link->subscribe(incomingTopic);
+        link->subscribe(broadcastTopic);
+        if (!link->connect(host, port)) {return 1;}
+    }
+
+    std::signal(SIGINT, [](int) { running = 0; });
+    std::signal(SIGTERM, [](int) { running = 0; });
+    printf("[firmware_sim] Simulating %d controller(s) %s%04d..%s%04d on %s:%d (time scale %.3f)\n", devices,
+        idPrefix.c_str(), 0, idPrefix.c_str(), devices - 1, host.c_str(), port, options.timeScale);
+    while (running) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    // Clean disconnect: mark controllers offline ourselves (the will is only published on unexpected drops)
+    for (SimController &controller : controllers) {
+        controller.link->publish(root + "/" + controller.id + "/status", "offline", true);
+        controller.link->disconnect();
+    }
+    return 0;
+}
@@ -0,0 +1,274 @@
+#include "sim_device.h"
+
+#include <chrono>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define SIM_HEAP_SIZE 300000u
+
+// Same text as dispenseResults in src/command_handling.cpp
+static const char *simDispenseResults[] = {"DONE", "ERROR 1: CURRENT OUTLIER", "ERROR 2: HOME TIMEOUT", "ERROR 3: MOTOR FLAGGED", "ERROR 4: OVERCURRENT"};
+
+uint8_t simMatrixIdx(char input) {
+    if (input >= 'A' && input <= 'F') {return input - 'A';}
+    if (input >= 'a' && input <= 'f') {return input - 'a';}
+    if (input >= '1' && input <= '8') {return input - '1';}
+    return 255;
+}
+
+char simRowValidator(char row) {
+    if (row >= 'a' && row <= 'f') {return row - 'a' + 'A';}
+    if (row >= 'A' && row <= 'F') {return row;}
+    return '\0';
+}
+
+SimDevice::SimDevice(const SimOptions &options, Reply reply)
+    : options_(options), reply_(std::move(reply)), rng_(options.seed) {
+    worker_ = std::thread(&SimDevice::worker, this);
+}
+
+SimDevice::~SimDevice() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        stopping_ = true;
+    }
+    queueCond_.notify_all();
+    worker_.join();
+}
+
+bool SimDevice::submit(const std::string &command) {
+    if (command.empty() || command.size() >= SIM_COMMAND_MAX_LEN) {return false;}
+    if (command.compare(0, 11, "rowreceived") == 0) { // Confirmations are not enqueued
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        rowConfirmations_ += 1;
+        queueCond_.notify_all();
+        return true;
+    }
+    std::unique_lock<std::mutex> lock(queueMutex_);
+    queueCond_.wait(lock, [this] { return queue_.size() < SIM_COMMAND_QUEUE_LEN || stopping_; });
+    if (stopping_) {return false;}
+    queue_.push_back(command);
+    queueCond_.notify_all();
+    return true;
+}
+
+void SimDevice::worker() {
+    while (true) {
+        std::string command;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            queueCond_.wait(lock, [this] { return !queue_.empty() || stopping_; });
+            if (stopping_) {return;}
+            command = queue_.front();
+            queue_.pop_front();
+        }
+        queueCond_.notify_all(); // Queue slot freed
+        execute(command);
+    }
+}
+
+void SimDevice::sleepMs(double ms) {
+    double scaled = ms * options_.timeScale;
+    if (scaled > 0) {std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(scaled));}
+}
+
+uint8_t &SimDevice::motorState(char row, char col) {
+    return motorStateMatrix_[simMatrixIdx(row)][simMatrixIdx(col)];
+}
+
+// Simulated runMotorOneRev: ~1.75 s revolution, optional injected home timeouts
+uint8_t SimDevice::runMotor(char row, char col) {
+    journalTxn_ += 1; // Start and finish record, like runMotorOneRev
+    journalSeq_ += 2;
+    if (motorState(row, col) != 0) {
+        reply_(std::string("Error;Motor ") + row + col + ";Flag " + std::to_string(motorState(row, col)));
+        return 3;
+    }
+    std::normal_distribution<double> revolution(1750.0, 30.0);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    if (chance(rng_) < options_.failRate) {
+        sleepMs(4000);
+        return 2;
+    }
+    sleepMs(revolution(rng_));
+    motorRuns_[simMatrixIdx(row)][simMatrixIdx(col)] += 1;
+    return 0;
+}
+
+void SimDevice::execute(const std::string &command) {
+    char response[64];
+    size_t delimiter = command.find(';');
+    if (delimiter == std::string::npos) {return;} // Firmware ignores commands without delimiter
+    std::string action = command.substr(0, delimiter);
+    std::string args = command.substr(delimiter + 1);
+    char row = args.size() > 0 ? simRowValidator(args[0]) : '\0';
+    char col = args.size() > 1 ? args[1] : '\0';
+
+    if (action == "disp") {
+        if (!row || simMatrixIdx(col) == 255) {
+            snprintf(response, sizeof(response), "INVALID CELL %c%c", row, col);
+            reply_(response);
+            return;
+        }
+        uint8_t result = runMotor(row, col);
+        motorState(row, col) = result;
+        snprintf(response, sizeof(response), "%s %s", action.c_str(), simDispenseResults[result]);
+        reply_(response);
+
+    } else if (action == "mdisp") {
+        std::string cols = args.size() > 1 ? args.substr(1) : "";
+        bool valid = row && !cols.empty() && cols.size() <= 8;
+        for (size_t i = 0; valid && i < cols.size(); i++) {
+            if (simMatrixIdx(cols[i]) == 255 || cols.find(cols[i], i + 1) != std::string::npos) {valid = false;}
+        }
+        if (!valid) {
+            snprintf(response, sizeof(response), "INVALID CELLS %s", args.c_str());
+            reply_(response);
+            return;
+        }
+        // Batches of up to 4 motors started 400 ms apart, each batch takes one revolution plus the stagger
+        size_t batches = (cols.size() + 3) / 4;
+        journalTxn_ += batches;
+        journalSeq_ += 2 * cols.size();
+        sleepMs(batches * 1750.0 + (cols.size() - batches) * 400.0);
+        int len = snprintf(response, sizeof(response), "%s DONE", action.c_str());
+        for (char c : cols) {
+            uint8_t result = motorState(row, c) != 0 ? 3 : 0;
+            motorState(row, c) = result;
+            len += snprintf(response + len, sizeof(response) - len, " %c%c:%u", row, c, result);
+        }
+        reply_(response);
+
+    } else if (action == "vend") {
+        auto entry = planogram_.find(args);
+        if (entry == planogram_.end()) {
+            snprintf(response, sizeof(response), "INVALID SKU %s", args.c_str());
+            reply_(response);
+            return;
+        }
+        const std::string &cells = entry->second;
+        char lastRow = '\0', lastCol = '\0';
+        uint8_t result = 3;
+        for (size_t i = 0; i + 1 < cells.size(); i += 3) {
+            char cellRow = simRowValidator(cells[i]);
+            char cellCol = cells[i + 1];
+            if (motorState(cellRow, cellCol) != 0) {continue;}
+            result = runMotor(cellRow, cellCol);
+            motorState(cellRow, cellCol) = result;
+            lastRow = cellRow;
+            lastCol = cellCol;
+            if (result == 0) {break;}
+        }
+        if (!lastRow) {
+            snprintf(response, sizeof(response), "%s ERROR: NO HEALTHY CELL", action.c_str());
+        } else {
+            snprintf(response, sizeof(response), "%s %s %c%c", action.c_str(), simDispenseResults[result], lastRow, lastCol);
+        }
+        reply_(response);
+
+    } else if (action == "plan") {
+        size_t equals = args.find('=');
+        if (equals != std::string::npos) {
+            std::string sku = args.substr(0, equals);
+            std::string cells = args.substr(equals + 1);
+            if (sku.empty() || sku.size() > 12) {
+                reply_("plan ERROR: INVALID PLANOGRAM");
+                return;
+            }
+            if (cells.empty()) {planogram_.erase(sku);}
+            else {planogram_[sku] = cells;}
+        } else {
+            for (const auto &entry : planogram_) {
+                if (!args.empty() && entry.first != args) {continue;}
+                reply_("PLAN;" + entry.first + ";" + entry.second);
+            }
+        }
+        reply_("plan DONE");
+
+    } else if (action == "tune") {
+        reply_("tune DONE");
+
+    } else if (action == "stop") {
+        sleepMs(160); // powerOffAll: 16 relays * 10 ms
+        reply_("stop DONE");
+
+    } else if (action == "test") {
+        size_t motors = !row ? 48 : (simMatrixIdx(col) == 255 ? 8 : 1);
+        sleepMs(1000 + motors * 105.0); // Baseline sampling + 20 samples per motor
+        reply_("test DONE");
+
+    } else if (action == "rst") {
+        for (char r = 'A'; r <= 'F'; r++) {
+            for (char c = '1'; c <= '8'; c++) {
+                if ((row && r != row) || (row && col && c != col)) {continue;}
+                motorState(r, c) = 0;
+            }
+        }
+        reply_("rst DONE");
+
+    } else if (action == "stats" || action == "clrstats") {
+        for (char r = 'A'; r <= 'F'; r++) {
+            for (char c = '1'; c <= '8'; c++) {
+                if ((row && r != row) || (simMatrixIdx(col) != 255 && c != col)) {continue;}
+                uint32_t &runs = motorRuns_[simMatrixIdx(r)][simMatrixIdx(c)];
+                if (action == "clrstats") {
+                    runs = 0;
+                } else if (runs > 0 || simMatrixIdx(col) != 255) {
+                    snprintf(response, sizeof(response), "STATS;%c%c;%u;0;200.0;2.0;1750;30;0.00", r, c, runs);
+                    reply_(response);
+                }
+            }
+        }
+        reply_(action + " DONE");
+
+    } else if (action == "heap") {
+        // Reports the simulator's own heap use against a nominal ESP32 heap size so the soak probes can be exercised end to end,
+        // marked SIMULATED so mqtt_loadtest gives no FLAT/DRIFTING verdict for it: only a real device reports firmware heap
+        unsigned int heapFree = SIM_HEAP_SIZE;
+#ifdef __GLIBC__
+        struct mallinfo2 info = mallinfo2();
+        heapFree = info.uordblks < SIM_HEAP_SIZE ? SIM_HEAP_SIZE - (unsigned int)info.uordblks : 0;
+#endif
+        snprintf(response, sizeof(response), "heap DONE FREE %u MIN %u LARGEST %u SIMULATED", heapFree, heapFree, heapFree);
+        reply_(response);
+
+    } else if (action == "idle") {
+        // No current sensor to sample, reports a quiet supply
+        reply_("idle DONE BASELINE 0.00 NOISE 0.00 SAMPLES 0 FAULTS 0");
+
+    } else if (action == "jrnl") {
+        // Journal counters only, the simulator never loses power mid-dispense
+        snprintf(response, sizeof(response), "JRNL;%u;%u;%u/%u", journalSeq_, journalTxn_ & 0xFFFF, journalSeq_ % SIM_JOURNAL_SLOTS,
+            SIM_JOURNAL_SLOTS);
+        reply_(response);
+        reply_(action + " DONE");
+
+    } else if (action == "send") {
+        // The Android row handshake only runs over Serial, MQTT just sees the completion
+        if (options_.serial) {
+            reply_("MOTORSTATEMATRIX;");
+            unsigned retries = 0;
+            for (int r = 0; r < 6 && retries < 5; r++) {
+                int len = snprintf(response, sizeof(response), "ROW%d;", r);
+                for (int c = 0; c < 8; c++) {len += snprintf(response + len, sizeof(response) - len, "%u,", motorStateMatrix_[r][c]);}
+                {
+                    std::lock_guard<std::mutex> lock(queueMutex_);
+                    rowConfirmations_ = 0;
+                }
+                reply_(response);
+                std::unique_lock<std::mutex> lock(queueMutex_);
+                if (queueCond_.wait_for(lock, std::chrono::milliseconds(2000), [this] { return rowConfirmations_ > 0 || stopping_; })) {
+                    retries = 0;
+                } else {
+                    r -= 1; // Repeat row
+                    retries += 1;
+                }
+            }
+        }
+        reply_("send motorStateMatrix DONE");
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef SIM_DEVICE_H
+#define SIM_DEVICE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Mirrors COMMAND_QUEUE_LEN / COMMAND_MAX_LEN in include/command_handling.h
+#define SIM_COMMAND_QUEUE_LEN 4
+#define SIM_COMMAND_MAX_LEN 64
+// Mirrors the journal partition size in partitions.csv / sizeof(journalRecord) in include/journal.h
+#define SIM_JOURNAL_SLOTS 4096
+
+struct SimOptions {
+    double timeScale = 1.0; // Multiplier on simulated motor/test durations (eg. 0.01 to load test the messaging path only)
+    double failRate = 0.0; // Probability that a dispense ends in a home timeout
+    unsigned seed = 1;
+    bool serial = false; // Serial framing: "send" streams MOTORSTATEMATRIX;/ROWn; lines and waits for rowreceived like sendMotorStateMatrix
+};
+
+/*
+Host-side stand-in for one motor controller: same command set and reply strings as src/command_handling.cpp,
+one command executed at a time from a bounded queue, motor timing and faults simulated
+Replies are passed to the reply callback (from the device's worker thread)
+*/
+class SimDevice {
+public:
+    using Reply = std::function<void(const std::string &)>;
+
+    SimDevice(const SimOptions &options, Reply reply);
+    ~SimDevice();
+
+    SimDevice(const SimDevice &) = delete;
+    SimDevice &operator=(const SimDevice &) = delete;
+
+    // Hands a received command to the device, blocking while the queue is full (like xQueueSend with portMAX_DELAY)
+    // Returns false if the command length is invalid
+    bool submit(const std::string &command);
+
+private:
+    void worker();
+    void execute(const std::string &command);
+    void sleepMs(double ms);
+    uint8_t runMotor(char row, char col);
+    uint8_t &motorState(char row, char col);
+
+    SimOptions options_;
+    Reply reply_;
+
+    std::mutex queueMutex_;
+    std::condition_variable queueCond_;
+    std::deque<std::string> queue_;
+    bool stopping_ = false;
+    unsigned rowConfirmations_ = 0; // rowreceived lines not yet consumed by the send handshake
+    std::thread worker_;
+
+    std::mt19937 rng_;
+    uint8_t motorStateMatrix_[6][8] = {};
+    uint32_t motorRuns_[6][8] = {};
+    unsigned journalSeq_ = 0; // Records the firmware journal would have appended
+    unsigned journalTxn_ = 0;
+    std::map<std::string, std::string> planogram_; // sku -> cell list as sent (eg. "a1,a2")
+};
+
+uint8_t simMatrixIdx(char input); // Same mapping as charToMatrixIdx(), 255 if invalid
+char simRowValidator(char row); // Same mapping as rowValidator(), '\0' if invalid
+
+#endif
@@ -1,9 +1,18 @@
 #ifndef COMMAND_HANDLING_H
 #define COMMAND_HANDLING_H
 
-extern QueueHandle_t commandQueue;
+struct commandStruct;
+
+extern QueueHandle_t commandQueue; // Indices of filled commandPool slots, in arrival order
+extern QueueHandle_t freeCommandQueue; // Indices of free commandPool slots
 #define COMMAND_QUEUE_LEN 4
 #define COMMAND_MAX_LEN 64
+#define COMMAND_POOL_LEN (COMMAND_QUEUE_LEN + 3) // Queued + executing + one being filled by each producer (Serial, MQTT)
+#define RESPONSE_MAX_LEN 64
+#define MQTT_OUTBOX_LEN 8 // Responses waiting for checkMQTT to publish them
+#define MQTT_OUTBOX_WAIT_MS 100 // Max wait for outbox room before a response is sent over Serial only
+#define LOG_MAX_LEN 128 // Longer log lines are truncated
+extern commandStruct commandPool[COMMAND_POOL_LEN];
 
 extern TaskHandle_t commandHandlerTaskHandle;
 extern TaskHandle_t serialHandlerTaskHandle;
@@ -12,8 +21,16 @@ extern TaskHandle_t checkMQTTStatusHandle;
 extern bool initialSetupDone;
 
 // Function declarations
-void commandHandler(void * params); // Dequeue complete command from commandQueue, parse command, execute command, send confirmation over Serial
-void serialHandler(void * params); // Look for delimiters, wait for queue slot to free up, buffer complete commands into queue when free
+bool initCommandPool(); // Create command/free slot queues, MQTT outbox and response mutex
+commandStruct * acquireCommandSlot(); // Take a free slot to fill in place, blocks while the pool is exhausted
+void submitCommandSlot(commandStruct * command);
+void releaseCommandSlot(commandStruct * command);
+void sendResponse(const char *format, ...) __attribute__((format(printf, 1, 2))); // Format into a reused buffer, send over Serial and MQTT
+void logPrintf(const char *format, ...) __attribute__((format(printf, 1, 2))); // Format into a reused buffer, write to Logger (Logger.printf allocates for lines over 64 chars)
+
+void commandHandler(void * params); // Dequeue complete command from commandQueue, parse and execute command in place, send confirmation over Serial and MQTT
+void serialHandler(void * params); // Frame commands byte by byte as UART events arrive, wait for queue slot to free up, buffer complete commands into queue when free
+void serialReceiveCallback(); // UART receive event hook, wakes serialHandler
 uint8_t charToMatrixIdx(char input);
 char rowValidator(char row);
 
@@ -22,8 +39,8 @@ void setup_wifi();
 void setup_mqtt();
 void reconnect();
 bool isMQTTConnected();
-void sendMQTTResponse(const char *input);
+void sendMQTTResponse(const char *input); // Queue for checkMQTT, the only task using PubSubClient once setup is done
 void mqttCallback(char* topic, byte* payload, unsigned int length);
-void checkMQTT(void * params);
+void checkMQTT(void * params); // Service MQTT client loop and reconnect on disconnect
 
 #endif
\ No newline at end of file
@@ -3,6 +3,38 @@
 
 extern uint8_t motorStateMatrix[6][8];
 
+#define STATS_MIN_RUNS 10 // Runs of history required before drift scores are computed
+#define STATS_DRIFT_WEIGHT 8 // Drift score is an EWMA of |z| with weight 1/STATS_DRIFT_WEIGHT
+
+// Incremental (Welford) health statistics for a single motor, updated after every dispense
+struct motorStatsStruct {
+  uint32_t runs; // Successful revolutions folded into the statistics
+  uint16_t failures; // Revolutions that ended in an error (outlier/timeout)
+  uint32_t current_runs; // Runs with an attributable run current (concurrent runs only measure combined current)
+  float current_mean; // Mean run current (mA)
+  float current_m2; // Sum of squared deviations of run current
+  float rev_mean; // Mean time to home (ms)
+  float rev_m2; // Sum of squared deviations of time to home
+  float current_z; // z-score of the latest run current against this motor's history
+  float rev_z; // z-score of the latest time to home against this motor's history
+  float drift; // Smoothed drift score (EWMA of the larger |z|), 0 until STATS_MIN_RUNS
+};
+
+extern motorStatsStruct motorStatsMatrix[6][8];
+
+// Idle current monitor, samples the INA219 between commands (see idleMonitor)
+#define IDLE_SAMPLE_INTERVAL_MS 50
+#define IDLE_SETTLE_MS 500 // Ignore samples this long after a command released the current sensor (relay/motor decay)
+#define IDLE_BASELINE_WEIGHT 32 // Baseline and noise are EWMAs with weight 1/IDLE_BASELINE_WEIGHT
+#define IDLE_MIN_SAMPLES 50 // Samples before the baseline is handed out
+#define IDLE_BASELINE_MAX_AGE_MS 60000 // Baseline not refreshed for this long (machine kept busy) is not handed out
+#define IDLE_FAULT_MIN_MA 10.0 // Unexpected draw threshold above baseline, raised to IDLE_FAULT_SIGMA * noise on a noisy supply
+#define IDLE_FAULT_SIGMA 6.0
+#define IDLE_FAULT_SAMPLES 5 // Consecutive samples above threshold before all relays are cut
+#define IDLE_BASELINE_MAX_MA 10.0 // Absolute limit while the baseline is learned, so a fault present at boot isn't learned as normal
+
+extern TaskHandle_t idleMonitorTaskHandle;
+
 // Function declarations
 void setMotorState(char row, char col, uint8_t state);
 uint8_t getMotorState(char row, char col);
@@ -11,4 +43,16 @@ void testSingleMotorState(char row, char col, float baseline);
 void testSystemMotorState(char row = '\0', char col = '\0');
 void sendMotorStateMatrix();
 
+void updateMotorStats(char row, char col, uint8_t result, float current, float rev_time); // current = NAN if not attributable to this motor
+float getMotorDrift(char row, char col);
+void clearMotorStats(char row = '\0', char col = '\0');
+void sendMotorStats(char row = '\0', char col = '\0');
+
+void sendHeapTelemetry();
+
+void idleMonitor(void * params); // Low priority task: maintain idle current baseline/noise, cut all relays on unexpected draw
+float getIdleBaseline(); // Live idle current baseline (mA), NAN if not (yet) valid
+void sendIdleMonitorStatus();
+void sendIdleFaultReport(); // Sends a fault latched by the idle monitor, called from the MQTT task (checkMQTT)
+
 #endif
\ No newline at end of file
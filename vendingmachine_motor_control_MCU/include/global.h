@@ -16,6 +16,8 @@
 extern Adafruit_INA219 ina219;
 extern HardwareSerial Logger;
 extern SemaphoreHandle_t androidConfirmation;
+extern SemaphoreHandle_t currentSenseMutex;
+extern volatile unsigned long currentSenseReleased;
 
 // WIFI details
 #define AP_NAME "ENTER_WIFI_NAME"
@@ -24,8 +26,16 @@ extern SemaphoreHandle_t androidConfirmation;
 // MQTT details
 #define mqtt_server "ENTER_MQTT_SERVER_IP"
 #define mqtt_port 1884 // Default setting, edit based on actual MQTT port
-#define mqtt_incoming_topic "topic/hostToClient"
-#define mqtt_outgoing_topic "topic/clientToHost"
+
+// MQTT namespacing, each controller derives its client ID and topics from its WiFi MAC (set up in setup_mqtt)
+// Topics: <root>/<deviceId>/hostToClient (commands), <root>/<deviceId>/clientToHost (responses), <root>/<deviceId>/status (retained online/offline)
+#define MQTT_TOPIC_ROOT "vmc"
+#define mqtt_broadcast_topic MQTT_TOPIC_ROOT "/all/hostToClient" // Commands to every controller on the broker
+extern char mqtt_device_id[13]; // MAC as 12 lowercase hex digits
+extern char mqtt_client_id[17]; // "vmc-" + device id
+extern char mqtt_incoming_topic[48];
+extern char mqtt_outgoing_topic[48];
+extern char mqtt_status_topic[48];
 
 struct commandStruct {
     int len;
@@ -0,0 +1,39 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+/*
+Append-only dispense journal in its own flash partition ("journal" in partitions.csv)
+Records are appended round robin across the partition's sectors (wear levelling), the sector after the write head is
+kept erased so appends during a dispense are plain 16 byte writes and never wait for a sector erase
+*/
+#define JOURNAL_PARTITION_LABEL "journal"
+#define JOURNAL_SECTOR_SIZE 4096
+#define JOURNAL_MAX_TXN_RECORDS (2 * 8) // Start + finish of every motor of the largest transaction (one row)
+
+#define JOURNAL_START 1 // Motor about to be powered
+#define JOURNAL_FINISH 2 // Motor powered off, result holds the runMotorOneRev code
+#define JOURNAL_RECOVERED 3 // Interrupted motor homed at boot
+
+// One journal record, exactly 16 bytes so records never straddle a flash page
+struct journalRecord {
+    uint32_t seq; // Increments with every record, 0xFFFFFFFF = erased slot
+    uint16_t txn; // Groups the records of one motor run or concurrent batch
+    uint8_t type;
+    char row;
+    char col;
+    uint8_t result;
+    uint16_t reserved;
+    uint32_t crc; // CRC32 of the preceding 12 bytes, torn writes fail the check
+};
+
+// Function declarations
+bool initJournal(); // Mount journal partition and locate write head (called once during setup), FALSE if partition missing
+void replayJournal(); // Home motors of an interrupted transaction and record their recovery (called once during setup)
+void sendJournalRecovery(); // Report motors found interrupted at boot over Serial and MQTT
+
+uint16_t journalStart(char row, const char *cols, uint8_t count); // One write for the whole batch, returns txn
+void journalFinish(uint16_t txn, char row, const char *cols, const uint8_t *results, uint8_t count); // Once the motors are powered off (one col at a time in a concurrent batch)
+void journalMaintain(); // Pre-erase the sector after the write head, call between commands (erase takes tens of ms)
+void sendJournalStatus();
+
+#endif
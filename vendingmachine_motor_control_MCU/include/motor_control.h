@@ -17,6 +17,36 @@ extern uint8_t col_values[8]; // ESP32 GPIO col pin
 extern bool areAnyRelaysOn;
 extern const float motorResistor;
 
+// Stall/jam detection defaults, tunable per motor (see motorTuningStruct)
+#define DEFAULT_OUTLIER_DELTA 50.0 // Excursion above rolling average beyond the home step counted as an outlier (mA)
+#define DEFAULT_MAX_OUTLIERS 8 // Consecutive outliers before aborting (8 * 5 ms poll interval)
+#define DEFAULT_OVERCURRENT_LIMIT 700.0 // Absolute current limit (mA)
+#define MOTOR_OVERCURRENT_SAMPLES 3 // Consecutive samples above limit before aborting, rides through start-up inrush
+
+struct motorTuningStruct {
+    float outlier_delta;
+    uint8_t max_outliers;
+    float overcurrent_limit;
+};
+
+extern motorTuningStruct motorTuningMatrix[6][8];
+
+// Concurrent (same row) dispense limits
+#define CABINET_CURRENT_BUDGET_MA 800.0 // Max combined motor current allowed when running motors concurrently
+#define MOTOR_NOMINAL_CURRENT_MA 200.0 // Assumed run current of a motor with no statistics yet
+#define CONCURRENT_MAX_MOTORS 4 // Starts must settle before the first motor can reach home, see CONCURRENT_STAGGER_MS
+#define CONCURRENT_STAGGER_MS 400 // Delay between motor starts, keeps each motor's start/home events separable in the combined current
+#define CONCURRENT_HOME_WINDOW_SD 3.0 // Home window half width in standard deviations of the motor's revolution time
+#define CONCURRENT_HOME_WINDOW_MIN_MS 60.0 // Minimum home window half width
+#define CONCURRENT_START_SETTLE_MS 250 // Motor start < t < cam leaves home position, no sampling
+#define CONCURRENT_CUT_SETTLE_MS 20 // Settling time after cutting a col before sampling resumes
+#define CONCURRENT_REBASELINE_MS 100 // Combined current re-averaged after each start/cut before home/outlier detection re-arms
+#define CONCURRENT_HOME_CONFIRM_SAMPLES 5 // Consecutive home step samples before a col is cut
+#define CONCURRENT_SAMPLE_PERIOD_MS 8 // Upper bound of one poll (5 ms delay + INA219 read + bookkeeping), for planning only
+#define CONCURRENT_PLAN_MARGIN_MS 30 // Slack on top of every planned separation (start slip, I2C retries)
+// Time a home event keeps the detector busy: confirmation, cut, settle and re-baseline
+#define CONCURRENT_HOME_BUSY_MS (CONCURRENT_HOME_CONFIRM_SAMPLES * CONCURRENT_SAMPLE_PERIOD_MS + CONCURRENT_CUT_SETTLE_MS + CONCURRENT_REBASELINE_MS)
+
 // Function declarations
 void relayPinSetup();
 
@@ -25,7 +55,13 @@ uint8_t getPin(char index);
 void powerOffAll();
 void checkRelayPower();
 
+void loadMotorTuning(); // Restore per motor tuning from NVS (called once during setup)
+motorTuningStruct getMotorTuning(char row, char col);
+bool setMotorTuning(char row, char col, const char *values); // values: "<outlier_delta>,<max_outliers>,<overcurrent_limit>", empty restores defaults
+void sendMotorTuning(char row, char col);
+
 void sendMotorHome(char row, char col); // Turn motor to home position (uses similar logic/process as runMotorOneRev)
-uint8_t runMotorOneRev(char row, char col); // Start motor then poll current sensor, take rolling average during revolution period, wait for current spike following revolution period. If current spike not received before timeout, return FALSE
+uint8_t runMotorOneRev(char row, char col); // Start motor then poll current sensor, take rolling average during revolution period, wait for current spike following revolution period. Aborts early on stall/jam, returns error code if current spike not received before timeout
+uint8_t runMotorsConcurrent(char row, const char *cols, uint8_t count, uint8_t *results); // Runs several motors on one row at once within the cabinet current budget, results per col use runMotorOneRev codes, sets motorStateMatrix for attributable results. Returns number of successful dispenses
 
 #endif
\ No newline at end of file
@@ -0,0 +1,26 @@
+#ifndef PLANOGRAM_H
+#define PLANOGRAM_H
+
+#define PLANOGRAM_MAX_PRODUCTS 24
+#define PLANOGRAM_MAX_CELLS 8 // Max cells one product can be stocked in
+#define SKU_MAX_LEN 12
+
+// Product to cell mapping, cells are stored as validated row/col chars (eg. {'A', '1'}) in order of preference
+struct planogramEntry {
+    char sku[SKU_MAX_LEN + 1]; // Empty sku marks a free slot
+    uint8_t cellCount;
+    char cells[PLANOGRAM_MAX_CELLS][2];
+};
+
+extern planogramEntry planogram[PLANOGRAM_MAX_PRODUCTS];
+
+// Function declarations
+void loadPlanogram(); // Restore planogram from NVS (called once during setup)
+bool savePlanogram();
+bool setPlanogramEntry(const char *sku, const char *cells); // cells: comma separated list (eg. "a1,a2,b3"), empty list removes sku
+planogramEntry * findPlanogramEntry(const char *sku);
+void sendPlanogram(const char *sku = NULL);
+
+uint8_t vendProduct(planogramEntry *entry, char *row, char *col); // Dispense from first healthy cell, failing over to the next cell on error. row/col: dispensing cell, or last cell tried on error ('\0' if every cell was flagged)
+
+#endif
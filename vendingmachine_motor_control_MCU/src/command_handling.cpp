@@ -2,10 +2,21 @@
 #include <command_handling.h>
 #include <motor_control.h>
 #include <diagnostics.h>
+#include <planogram.h>
+#include <journal.h>
+#include <esp_heap_caps.h>
 
 WiFiClient espClient;
 PubSubClient client(espClient);
 bool initialSetupDone = false;
+static volatile bool mqttConnected = false; // Last connection state seen by the MQTT task, read by other tasks instead of PubSubClient
+static QueueHandle_t mqttOutbox = NULL; // RESPONSE_MAX_LEN byte responses, published by checkMQTT
+
+char mqtt_device_id[13];
+char mqtt_client_id[17];
+char mqtt_incoming_topic[48];
+char mqtt_outgoing_topic[48];
+char mqtt_status_topic[48];
 
 void setup_wifi() {
   delay(10);
@@ -21,6 +32,17 @@ void setup_wifi() {
 }
 
 void setup_mqtt() {
+  // Per device client ID and topics, so several controllers can share one broker
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  snprintf(mqtt_device_id, sizeof(mqtt_device_id), "%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+  snprintf(mqtt_client_id, sizeof(mqtt_client_id), "vmc-%s", mqtt_device_id);
+  snprintf(mqtt_incoming_topic, sizeof(mqtt_incoming_topic), "%s/%s/hostToClient", MQTT_TOPIC_ROOT, mqtt_device_id);
+  snprintf(mqtt_outgoing_topic, sizeof(mqtt_outgoing_topic), "%s/%s/clientToHost", MQTT_TOPIC_ROOT, mqtt_device_id);
+  snprintf(mqtt_status_topic, sizeof(mqtt_status_topic), "%s/%s/status", MQTT_TOPIC_ROOT, mqtt_device_id);
+  logPrintf("[Logger] MQTT device id %s\n", mqtt_device_id);
+  Serial.printf("MQTT DEVICE %s\n", mqtt_device_id);
+
   client.setServer(mqtt_server, mqtt_port);
   client.setCallback(mqttCallback);
   reconnect();
@@ -29,23 +51,110 @@ void setup_mqtt() {
 
 void reconnect() {
   Logger.println("[Logger] Attempting MQTT connection...");
-  while (!client.connect("ESP32Client")) {
+  // Broker publishes the retained "offline" will if this controller drops off without disconnecting
+  while (!client.connect(mqtt_client_id, mqtt_status_topic, 1, true, "offline")) {
     Logger.print("[Logger] MQTT connection failed, rc=");
     Logger.print(client.state());
     Logger.println(" try again in 5 seconds");
     delay(5000);
   }
-  Logger.printf("[Logger] MQTT connected via port %d on server %s\n", mqtt_port, mqtt_server);
+  logPrintf("[Logger] MQTT connected via port %d on server %s\n", mqtt_port, mqtt_server);
   client.subscribe(mqtt_incoming_topic);
+  client.subscribe(mqtt_broadcast_topic);
+  client.publish(mqtt_status_topic, "online", true);
+  mqttConnected = true;
 }
 
 bool isMQTTConnected() {
-  if (client.connected()) {return true;}
-  else {return false;}
+  return mqttConnected;
 }
 
+/*
+Queues a response for checkMQTT to publish. PubSubClient isn't thread safe and client.loop() runs in checkMQTT, so no
+other task may publish directly. A lock around client.loop() instead would deadlock: mqttCallback runs inside it and
+waits for commandHandler, which may be waiting to publish a response. Dropped (logged) if the outbox stays full
+*/
 void sendMQTTResponse(const char *input) {
-  client.publish(mqtt_outgoing_topic, input);
+  char item[RESPONSE_MAX_LEN];
+  strncpy(item, input, sizeof(item) - 1);
+  item[sizeof(item) - 1] = '\0';
+  if (xQueueSend(mqttOutbox, item, pdMS_TO_TICKS(MQTT_OUTBOX_WAIT_MS)) != pdTRUE) {
+    logPrintf("[Logger] MQTT outbox full, response sent over Serial only: %s\n", item);
+  }
+}
+
+/*
+Fixed footprint command path: commands live in a static pool of COMMAND_POOL_LEN slots for their whole lifetime
+Producers (serialHandler, mqttCallback) take a free slot, fill it in place and queue its index, commandHandler executes
+the slot in place and returns it. A producer blocks while no slot is free, like the old blocking xQueueSend
+*/
+commandStruct commandPool[COMMAND_POOL_LEN];
+QueueHandle_t freeCommandQueue = NULL;
+static SemaphoreHandle_t responseMutex = NULL;
+static SemaphoreHandle_t logMutex = NULL; // NULL during setup, when only the setup task logs
+
+// Creates commandQueue, the free slot queue, the MQTT outbox and the response mutex, returns FALSE if any creation failed
+bool initCommandPool() {
+  commandQueue = xQueueCreate(COMMAND_QUEUE_LEN, sizeof(uint8_t)); // Queue depth seen by hosts, the pool only adds slot storage
+  freeCommandQueue = xQueueCreate(COMMAND_POOL_LEN, sizeof(uint8_t));
+  mqttOutbox = xQueueCreate(MQTT_OUTBOX_LEN, RESPONSE_MAX_LEN); // Item storage allocated once here, like the command pool
+  responseMutex = xSemaphoreCreateMutex();
+  if (logMutex == NULL) {logMutex = xSemaphoreCreateMutex();}
+  if (commandQueue == NULL || freeCommandQueue == NULL || mqttOutbox == NULL || responseMutex == NULL || logMutex == NULL) {return false;}
+  for (uint8_t slot = 0; slot < COMMAND_POOL_LEN; slot++) {
+    xQueueSend(freeCommandQueue, &slot, 0);
+  }
+  return true;
+}
+
+// Takes a free command slot, waits until one is freed if the pool is exhausted
+commandStruct * acquireCommandSlot() {
+  uint8_t slot;
+  xQueueReceive(freeCommandQueue, &slot, portMAX_DELAY);
+  commandPool[slot].len = 0;
+  return &commandPool[slot];
+}
+
+// Queues a filled command slot for commandHandler, waits while COMMAND_QUEUE_LEN commands are already queued
+void submitCommandSlot(commandStruct * command) {
+  uint8_t slot = command - commandPool;
+  xQueueSend(commandQueue, &slot, portMAX_DELAY);
+}
+
+// Returns a command slot to the pool
+void releaseCommandSlot(commandStruct * command) {
+  uint8_t slot = command - commandPool;
+  xQueueSend(freeCommandQueue, &slot, portMAX_DELAY);
+}
+
+/*
+Formats a response into one reused static buffer and sends it over Serial and MQTT
+Stays off the heap as long as the response fits RESPONSE_MAX_LEN (longer responses are truncated)
+*/
+void sendResponse(const char *format, ...) {
+  static char response[RESPONSE_MAX_LEN];
+  xSemaphoreTake(responseMutex, portMAX_DELAY);
+  va_list args;
+  va_start(args, format);
+  vsnprintf(response, sizeof(response), format, args);
+  va_end(args);
+  Serial.println(response);
+  if (isMQTTConnected()) {
+    sendMQTTResponse(response);
+  }
+  xSemaphoreGive(responseMutex);
+}
+
+// Formats a log line into a reused buffer and writes it to Logger, keeps logging off the heap like sendResponse
+void logPrintf(const char *format, ...) {
+  static char line[LOG_MAX_LEN];
+  if (logMutex) {xSemaphoreTake(logMutex, portMAX_DELAY);}
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  Logger.print(line);
+  if (logMutex) {xSemaphoreGive(logMutex);}
 }
 
 /*
@@ -127,145 +236,206 @@ char rowValidator(char row) {
   }
 }
 
+// Dispense reply text per runMotorOneRev result code
+static const char * const dispenseResults[] = {
+  "DONE",
+  "ERROR 1: CURRENT OUTLIER",
+  "ERROR 2: HOME TIMEOUT",
+  "ERROR 3: MOTOR FLAGGED",
+  "ERROR 4: OVERCURRENT"
+};
+
+// Sends INVALID CELL error for the parsed row/col
+static void sendInvalidCell(char row, char col) {
+  sendResponse("INVALID CELL %c%c", row, col);
+}
+
 /*
-Dequeues commands (char array) from commandQueue and executes based on [action;cell] structure
+Parses and executes one command in place (the pool slot is modified, nothing is copied) based on [action;cell] structure
 Dispense actions are executed only for indicated cell, stop and test actions are executed for all cells regardless of indication
-Prints received action over serial + success/error
+Sends received action success/error over Serial and MQTT
 */
-void commandHandler(void * params) {
-  commandStruct command;
+static void executeCommand(commandStruct * command) {
+  Logger.print("[Logger] [commandHandler] Command received: ");
+  Logger.println(command->charArray);
+  char row = '\0', col = '\0';
 
-  while (true) {
-    // Check if there are commands in the queue
-    if (uxQueueMessagesWaiting(commandQueue) > 0) {
-      if (xQueueReceive(commandQueue, &command, 0) == pdPASS) {
-        Logger.print("[Logger] [commandHandler] Command received: ");
-        Logger.println(command.charArray);
-        char action[14]; // eg. "disp", "stop", "test"
-        char cell[3] = {'\0', '\0', '\0'}; // eg. "a4", "b2"
-        char row = '\0', col = '\0';
-        
-        char delimiter = ';';
-        char * delimiterPos = strchr(command.charArray, delimiter);
-        if (delimiterPos != NULL) { // Found delimiter, valid command received
-          size_t actionLen = delimiterPos - command.charArray;
-          strncpy(action, command.charArray, actionLen);
-          action[actionLen] = '\0';
-          Logger.print("[Logger] [commandHandler] action: ");
-          Logger.println(action);
-
-          // Parse row and col
-          if (*(delimiterPos + 1)) {row = rowValidator(*(delimiterPos + 1));}
-          if (*(delimiterPos + 2)) {col = *(delimiterPos + 2);}
-          Logger.printf("[Logger] [commandHandler] row: %c, col: %c\n", row, col);
-
-          if (strcmp("disp", action) == 0) {
-            if (!row | charToMatrixIdx(col) == 255) {
-              char errorResponse[64];
-              snprintf(errorResponse, sizeof(errorResponse), "INVALID CELL %c%c", row, col);
-              Serial.println(errorResponse);
-              if (isMQTTConnected()) {
-                sendMQTTResponse(errorResponse);
-              }
-              delay(5);
-              continue;
-            }
-            uint8_t result = runMotorOneRev(row, col);
-            setMotorState(row, col, result);
-            
-            char response[64];
-            switch (result) {
-              case 0:
-                snprintf(response, sizeof(response), "%s DONE", action);
-                break;
-              case 1:
-                snprintf(response, sizeof(response), "%s ERROR 1: CURRENT OUTLIER", action);
-                break;
-              case 2:
-                snprintf(response, sizeof(response), "%s ERROR 2: HOME TIMEOUT", action);
-                break;
-              case 3:
-                snprintf(response, sizeof(response), "%s ERROR 3: MOTOR FLAGGED", action);
-                break;
-            }
-            
-            // Send response to both Serial and MQTT
-            Serial.println(response);
-            if (isMQTTConnected()) {
-              sendMQTTResponse(response);
-            }
-          } else if (strcmp("stop", action) == 0) {
-            powerOffAll();
-            const char* response = "stop DONE";
-            Serial.println(response);
-            if (isMQTTConnected()) {
-              sendMQTTResponse(response);
-            }
-
-          } else if (strcmp("test", action) == 0) {
-            if (!row && !col) { // Test whole system
-              testSystemMotorState();
-            } else if (row && !col) {
-              // Test row motor state
-              testSystemMotorState(row);
-            } else {
-              // Test row motor state
-              testSystemMotorState(row, col);
-            }
-            const char* response = "test DONE";
-            Serial.println(response);
-            if (isMQTTConnected()) {
-              sendMQTTResponse(response);
-            }
-            
-          } else if (strcmp("rst", action) == 0) { // Resets specific motor flag
-            if (!row && !col) { // Reset whole motorStateMatrix
-              for (uint8_t i = 0; i < sizeof(motorStateMatrix) / sizeof(motorStateMatrix[0]); i++) {
-                for (uint8_t j = 0; j < sizeof(motorStateMatrix[i]) / sizeof(motorStateMatrix[i][0]); j++) {
-                    motorStateMatrix[i][j] = 0;
-                }
-              }
-            } else if (row && !col) { // Reset one row of motorStateMatrix
-                uint8_t rowIdx = charToMatrixIdx(row);
-                for (uint8_t i = 0; i < sizeof(motorStateMatrix[rowIdx]) / sizeof(motorStateMatrix[rowIdx][0]); i++) {
-                    motorStateMatrix[rowIdx][i] = 0;
-                }
-            } else if (row && col) {
-                setMotorState(row, col, 0);
-            } else {
-              char errorResponse[64];
-              snprintf(errorResponse, sizeof(errorResponse), "INVALID CELL %c%c", row, col);
-              Serial.println(errorResponse);
-              if (isMQTTConnected()) {
-                sendMQTTResponse(errorResponse);
-              }
-              delay(5);
-              continue;
-            }
-            const char* response = "rst DONE";
-            Serial.println(response);
-            if (isMQTTConnected()) {
-              sendMQTTResponse(response);
-            }
-            
-          } else if (strcmp("send", action) == 0) { // Send motorStateMatrix to android tablet
-            sendMotorStateMatrix();
-            const char* response = "send motorStateMatrix DONE";
-            Serial.println(response);
-            if (isMQTTConnected()) {
-              sendMQTTResponse(response);
-            }
-          }
+  char delimiter = ';';
+  char * delimiterPos = strchr(command->charArray, delimiter);
+  if (delimiterPos == NULL) {return;} // No delimiter, not a valid command
+
+  // Terminate action in place (eg. "disp", "stop", "test")
+  *delimiterPos = '\0';
+  const char * action = command->charArray;
+  Logger.print("[Logger] [commandHandler] action: ");
+  Logger.println(action);
+
+  // Parse row and col
+  if (*(delimiterPos + 1)) {
+    row = rowValidator(*(delimiterPos + 1));
+    col = *(delimiterPos + 2);
+  }
+  logPrintf("[Logger] [commandHandler] row: %c, col: %c\n", row, col);
+
+  if (strcmp("disp", action) == 0) {
+    if (!row | charToMatrixIdx(col) == 255) {
+      sendInvalidCell(row, col);
+      return;
+    }
+    uint8_t result = runMotorOneRev(row, col);
+    setMotorState(row, col, result);
+    sendResponse("%s %s", action, dispenseResults[result]);
+
+  } else if (strcmp("mdisp", action) == 0) { // Concurrent dispense from several cols of one row (eg. mdisp;a135)
+    char * cols = delimiterPos + 2;
+    uint8_t count = row ? strlen(cols) : 0;
+    bool valid = count > 0 && count <= sizeof(col_keys) / sizeof(col_keys[0]);
+    for (uint8_t i = 0; valid && i < count; i++) {
+      if (charToMatrixIdx(cols[i]) == 255 || strchr(cols + i + 1, cols[i]) != NULL) {valid = false;} // Invalid or repeated col
+    }
+    if (!valid) {
+      sendResponse("INVALID CELLS %s", delimiterPos + 1);
+      return;
+    }
+    uint8_t results[8];
+    runMotorsConcurrent(row, cols, count, results);
+
+    // Per cell results, " A1:0" is 5 chars per col
+    char summary[8 * 5 + 1];
+    int len = 0;
+    for (uint8_t i = 0; i < count; i++) { // motorStateMatrix already set by runMotorsConcurrent
+      len += snprintf(summary + len, sizeof(summary) - len, " %c%c:%u", row, cols[i], results[i]);
+    }
+    sendResponse("%s DONE%s", action, summary);
+
+  } else if (strcmp("vend", action) == 0) { // Dispense product by sku, failing over to alternate cells
+    char * sku = delimiterPos + 1;
+    planogramEntry * entry = findPlanogramEntry(sku);
+    if (!entry) {
+      sendResponse("INVALID SKU %s", sku);
+      return;
+    }
+    char vendRow = '\0', vendCol = '\0';
+    uint8_t result = vendProduct(entry, &vendRow, &vendCol);
+    if (!vendRow) {
+      sendResponse("%s ERROR: NO HEALTHY CELL", action); // Every cell already flagged, nothing was run
+    } else {
+      sendResponse("%s %s %c%c", action, dispenseResults[result], vendRow, vendCol); // Dispensing cell, or last cell tried and its error
+    }
+
+  } else if (strcmp("plan", action) == 0) { // Set (plan;<sku>=<cell>,<cell>) or send (plan;<sku> / plan;) planogram
+    char * sku = delimiterPos + 1;
+    char * cells = strchr(sku, '=');
+    if (cells != NULL) {
+      *cells = '\0';
+      if (!setPlanogramEntry(sku, cells + 1)) {
+        sendResponse("%s ERROR: INVALID PLANOGRAM", action);
+        return;
+      }
+    } else {
+      sendPlanogram(sku);
+    }
+    sendResponse("%s DONE", action);
+
+  } else if (strcmp("tune", action) == 0) { // Set (tune;<cell>=<outlier_delta>,<max_outliers>,<overcurrent_limit>) or send (tune;<cell>) stall/jam detection tuning
+    char * values = strchr(delimiterPos + 1, '=');
+    if (!row || charToMatrixIdx(col) == 255 || (values != NULL && values != delimiterPos + 3)) {
+      sendInvalidCell(row, col);
+      return;
+    }
+    if (values != NULL) {
+      if (!setMotorTuning(row, col, values + 1)) {
+        sendResponse("%s ERROR: INVALID TUNING", action);
+        return;
+      }
+    } else {
+      sendMotorTuning(row, col);
+    }
+    sendResponse("%s DONE", action);
+
+  } else if (strcmp("stop", action) == 0) {
+    powerOffAll();
+    sendResponse("%s DONE", action);
+
+  } else if (strcmp("test", action) == 0) {
+    if (!row && !col) { // Test whole system
+      testSystemMotorState();
+    } else if (row && !col) {
+      // Test row motor state
+      testSystemMotorState(row);
+    } else {
+      // Test row motor state
+      testSystemMotorState(row, col);
+    }
+    sendResponse("%s DONE", action);
+
+  } else if (strcmp("rst", action) == 0) { // Resets specific motor flag
+    if (!row && !col) { // Reset whole motorStateMatrix
+      for (uint8_t i = 0; i < sizeof(motorStateMatrix) / sizeof(motorStateMatrix[0]); i++) {
+        for (uint8_t j = 0; j < sizeof(motorStateMatrix[i]) / sizeof(motorStateMatrix[i][0]); j++) {
+            motorStateMatrix[i][j] = 0;
         }
       }
+    } else if (row && !col) { // Reset one row of motorStateMatrix
+        uint8_t rowIdx = charToMatrixIdx(row);
+        for (uint8_t i = 0; i < sizeof(motorStateMatrix[rowIdx]) / sizeof(motorStateMatrix[rowIdx][0]); i++) {
+            motorStateMatrix[rowIdx][i] = 0;
+        }
+    } else if (row && col) {
+        setMotorState(row, col, 0);
+    } else {
+      sendInvalidCell(row, col);
+      return;
     }
-    delay(5);
-    // Monitor stack usage every 1000 loops
+    sendResponse("%s DONE", action);
+
+  } else if (strcmp("stats", action) == 0) { // Send motor health statistics (single/row/all)
+    sendMotorStats(row, charToMatrixIdx(col) == 255 ? '\0' : col);
+    sendResponse("%s DONE", action);
+
+  } else if (strcmp("clrstats", action) == 0) { // Clears motor health statistics, eg. after a motor swap
+    clearMotorStats(row, charToMatrixIdx(col) == 255 ? '\0' : col);
+    sendResponse("%s DONE", action);
+
+  } else if (strcmp("heap", action) == 0) { // Heap telemetry, watch LARGEST for fragmentation over long uptimes
+    sendHeapTelemetry();
+
+  } else if (strcmp("idle", action) == 0) { // Idle current monitor baseline, noise and fault count
+    sendIdleMonitorStatus();
+
+  } else if (strcmp("jrnl", action) == 0) { // Dispense journal head and motors recovered at boot
+    sendJournalStatus();
+    sendResponse("%s DONE", action);
+
+  } else if (strcmp("send", action) == 0) { // Send motorStateMatrix to android tablet
+    sendMotorStateMatrix();
+    sendResponse("%s motorStateMatrix DONE", action);
+  }
+}
+
+/*
+Dequeues commands (commandPool slot index) from commandQueue, executes them in place and returns the slot to the pool
+*/
+void commandHandler(void * params) {
+  uint8_t slot;
+
+  while (true) {
+    // Block until a command is queued (timeout only so the stack watermark below keeps getting logged while idle)
+    if (xQueueReceive(commandQueue, &slot, pdMS_TO_TICKS(1000)) == pdPASS) {
+      xSemaphoreTake(currentSenseMutex, portMAX_DELAY); // Pauses the idle monitor for the whole command
+      executeCommand(&commandPool[slot]);
+      currentSenseReleased = millis(); // Idle monitor settle period starts here, however short the command was
+      xSemaphoreGive(currentSenseMutex);
+      releaseCommandSlot(&commandPool[slot]);
+      journalMaintain(); // Any sector erase happens here, between commands
+    }
+    // Monitor stack and heap usage every 100 loops
     static int counter = 0;
-    if (++counter >= 10000) {
+    if (++counter >= 100) {
       counter = 0;
       UBaseType_t watermark = uxTaskGetStackHighWaterMark(NULL);
-      Logger.printf("[Logger] [commandHandler] Stack high water mark: %u\n", watermark);
+      logPrintf("[Logger] [commandHandler] Stack high water mark: %u\n", watermark);
+      logPrintf("[Logger] Heap free %u, largest %u\n", ESP.getFreeHeap(), (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
     }
   }
 }
@@ -281,58 +451,84 @@ Nothing after delimiter means 'all' for stop and test. disp will never activate
 */
 
 /*
-Buffers full commands (terminator '\n') into commandQueue as commandStruct (len and charArray)
-Drops command if commandQueue is full or received command length is invalid
-Prints RECEIVE SUCCESS/FAIL over serial
+UART receive callback, runs in the UART driver's event task as soon as bytes arrive (RX FIFO threshold or RX idle timeout)
+Only wakes serialHandler, parsing stays out of the driver's event task
+*/
+void serialReceiveCallback() {
+  if (serialHandlerTaskHandle != NULL) {
+    xTaskNotifyGive(serialHandlerTaskHandle);
+  }
+}
+
+/*
+Hands a complete line framed in a command slot off to commandQueue
+Android confirmations ("rowreceived") release sendMotorStateMatrix instead of being enqueued
+Returns FALSE if the slot was not queued (caller keeps using it)
+Prints RECEIVE SUCCESS over serial
+*/
+static bool dispatchCommand(commandStruct * command, const char * source) {
+  if (strncmp("rowreceived", command->charArray, 9) == 0) { // Confirmation received from Android
+    xSemaphoreGive(androidConfirmation);
+    return false; // Don't enqueue confirmation (not an action)
+  }
+  submitCommandSlot(command);
+  logPrintf("[Logger] [%s] Command enqueued\n", source);
+  Serial.println("RECEIVE SUCCESS"); // TODO for android device: only move on to next command if "RECEIVE SUCCESS"
+  return true;
+}
+
+/*
+Streaming line parser: sleeps until serialReceiveCallback signals new bytes, then frames commands byte by byte
+directly into a command pool slot. A command is complete on '\n' regardless of its length ('\r' is ignored),
+so short commands (eg. "stop;") are handed off immediately
+Empty and overlong (>= COMMAND_MAX_LEN) lines are discarded up to their terminator with RECEIVE FAIL
 */
 void serialHandler(void * params) {
-  commandStruct serialBuffer;
+  commandStruct * serialBuffer = NULL; // Slot currently being framed, taken on the first byte of a line
+  bool overflow = false; // Current line exceeded COMMAND_MAX_LEN, discard until terminator
 
   while (true) {
-    if (Serial.available() >= 7) { // wait for minimum command size before reading
-      int len = Serial.readBytesUntil('\n', serialBuffer.charArray, COMMAND_MAX_LEN - 1);
-      if (len <= 0 || len >= COMMAND_MAX_LEN) { // Handle invalid command lengths
-        Logger.println("[Logger] [serialHandler] Command length invalid, discarding input");
-        while (Serial.available() > 0) {
-          Serial.read(); // Flush buffer
-          delay(1);
-        }
-        Serial.println("RECEIVE FAIL");
-        continue;
-      } else {
-        serialBuffer.charArray[len] = '\0';
-        serialBuffer.len = len;
+    // Block until bytes arrive (timeout only so the stack watermark below keeps getting logged while idle)
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
 
-        if (strncmp("rowreceived", serialBuffer.charArray, 9) == 0) { // Confirmation received from Android
-          xSemaphoreGive(androidConfirmation);
-          continue; // Don't enqueue confirmation (not an action)
-        }
-        if (xQueueSend(commandQueue, &serialBuffer, portMAX_DELAY) == errQUEUE_FULL) {
-          Logger.println("[Logger] [serialHandler] Command queue full, dropping command");
-          Serial.println("RECEIVE FAIL"); // TODO for android device: resend command if "RECEIVE FAIL"
+    while (Serial.available() > 0) {
+      int c = Serial.read();
+      if (c < 0 || c == '\r') {continue;}
+
+      if (c == '\n') {
+        if (overflow || serialBuffer == NULL || serialBuffer->len == 0) { // Handle invalid command lengths
+          Logger.println("[Logger] [serialHandler] Command length invalid, discarding input");
+          Serial.println("RECEIVE FAIL");
         } else {
-          Logger.println("[Logger] [serialHandler] Command enqueued");
-          Serial.println("RECEIVE SUCCESS"); // TODO for android device: only move on to next command if "RECEIVE SUCCESS"
+          serialBuffer->charArray[serialBuffer->len] = '\0';
+          if (dispatchCommand(serialBuffer, "serialHandler")) {serialBuffer = NULL;}
         }
+        if (serialBuffer != NULL) {serialBuffer->len = 0;}
+        overflow = false;
+        continue;
+      }
+
+      if (serialBuffer == NULL) {serialBuffer = acquireCommandSlot();}
+      if (serialBuffer->len >= COMMAND_MAX_LEN - 1) {
+        overflow = true;
+        continue;
       }
+      serialBuffer->charArray[serialBuffer->len++] = (char)c;
     }
-    // Monitor stack usage every 10000 loops
+
+    // Monitor stack usage every 100 loops
     static int counter = 0;
-    if (++counter >= 10000) {
+    if (++counter >= 100) {
       counter = 0;
       UBaseType_t watermark = uxTaskGetStackHighWaterMark(NULL);
-      Logger.printf("[Logger] [serialHandler] Stack high water mark: %u\n", watermark);
+      logPrintf("[Logger] [serialHandler] Stack high water mark: %u\n", watermark);
     }
-    client.loop();
-    delay(5);
   }
 }
 
+// Copies MQTT payload (owned by PubSubClient's buffer) straight into a command pool slot and queues it
 void mqttCallback(char* topic, byte* payload, unsigned int length) {
-  Logger.printf("[Logger] Received on MQTT: %s\n", payload);
-  commandStruct mqttBuffer;
-
-  if (strcmp(topic, mqtt_incoming_topic) != 0) {return;}
+  if (strcmp(topic, mqtt_incoming_topic) != 0 && strcmp(topic, mqtt_broadcast_topic) != 0) {return;}
 
   // Reject incorrect payload lengths
   if (length <= 0 || length >= COMMAND_MAX_LEN) { // Handle invalid command lengths
@@ -340,31 +536,39 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
     return;
   }
 
-  // Copy payload to charArray
-  memcpy(mqttBuffer.charArray, payload, length);
-  mqttBuffer.charArray[length] = '\0';
-  mqttBuffer.len = length;
-
-  if (strncmp("rowreceived", mqttBuffer.charArray, 9) == 0) { // Confirmation received from Android
-    xSemaphoreGive(androidConfirmation);
-    return; // Don't enqueue confirmation (not an action)
-  }
+  commandStruct * mqttBuffer = acquireCommandSlot();
+  memcpy(mqttBuffer->charArray, payload, length);
+  mqttBuffer->charArray[length] = '\0';
+  mqttBuffer->len = length;
+  Logger.print("[Logger] Received on MQTT: ");
+  Logger.println(mqttBuffer->charArray);
 
-  if (xQueueSend(commandQueue, &mqttBuffer, portMAX_DELAY) == errQUEUE_FULL) {
-    Logger.println("[Logger] [serialHandler] Command queue full, dropping command");
-    Serial.println("RECEIVE FAIL"); // TODO for android device: resend command if "RECEIVE FAIL"
-  } else {
-    Logger.println("[Logger] [serialHandler] Command enqueued");
-    Serial.println("RECEIVE SUCCESS"); // TODO for android device: only move on to next command if "RECEIVE SUCCESS"
+  if (!dispatchCommand(mqttBuffer, "mqttCallback")) {
+    releaseCommandSlot(mqttBuffer);
   }
 }
 
+/*
+Services the MQTT client (incoming messages, keepalive), publishes queued responses and reconnects if the connection drops
+The only task using PubSubClient once setup_mqtt is done, every other task queues its responses (see sendMQTTResponse)
+*/
 void checkMQTT(void * params) {
+  static char outgoing[RESPONSE_MAX_LEN];
   while (1) {
-    // Once initial MQTT setup is done, if MQTT disconnects this will get triggered
-    if (!isMQTTConnected() && initialSetupDone) {
-        reconnect();
+    // setup_mqtt (setup task) owns the client until the initial connection is up
+    if (!initialSetupDone) {
+      delay(5);
+      continue;
+    }
+    if (!client.connected()) {
+      mqttConnected = false;
+      reconnect();
     }
-    delay(100);
+    sendIdleFaultReport();
+    while (xQueueReceive(mqttOutbox, outgoing, 0) == pdTRUE) {
+      client.publish(mqtt_outgoing_topic, outgoing);
+    }
+    client.loop();
+    delay(5);
   }
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <diagnostics.h>
 #include <command_handling.h>
 #include <motor_control.h>
+#include <esp_heap_caps.h>
 
 uint8_t motorStateMatrix[6][8] = {
     {0, 0, 0, 0, 0, 0, 0, 0},
@@ -12,9 +13,11 @@ uint8_t motorStateMatrix[6][8] = {
     {0, 0, 0, 0, 0, 0, 0, 0}
 };
 
+motorStatsStruct motorStatsMatrix[6][8] = {};
+
 /* 
 Sets motor state in appropriate cell of motorStateMatrix 
-(0: functional, 1: outlier error, 2: timeout error, 3: shortcircuit error) 
+(0: functional, 1: outlier error, 2: timeout error, 3: shortcircuit error, 4: overcurrent error) 
 */
 void setMotorState(char row, char col, uint8_t state) {
   uint8_t rowIdx = charToMatrixIdx(row);
@@ -28,7 +31,7 @@ void setMotorState(char row, char col, uint8_t state) {
 
 /*
 Gets motor state from appropriate cell of motorStateMatrix 
-(0: functional, 1: outlier error, 2: timeout error, 3: shortcircuit error)
+(0: functional, 1: outlier error, 2: timeout error, 3: shortcircuit error, 4: overcurrent error)
 */
 uint8_t getMotorState(char row, char col) {
   uint8_t rowIdx = charToMatrixIdx(row);
@@ -58,26 +61,29 @@ void testSingleMotorState(char row, char col, float baseline) {
       relayControl(row, col, 0); // Cut power to motor
       setMotorState(row, col, 3); // Flag motor with shortcircuit error
       Serial.printf("Error;Motor %c%c;Flag 3\n", row, col);
-      Logger.printf("[Logger] i_curr = %f, i_baseline = %f\n", i_curr, baseline);
+      logPrintf("[Logger] i_curr = %f, i_baseline = %f\n", i_curr, baseline);
       return;
     }
     delay(5);
   }
   relayControl(row, col, 0);
   setMotorState(row, col, 0);
-  Logger.printf("[Logger] Motor %c%c functional\n", row, col);
+  logPrintf("[Logger] Motor %c%c functional\n", row, col);
 }
 
-// Establishes baseline then tests motor (single/row/all) state using testSingleMotorState
+// Establishes baseline (live idle monitor baseline if available) then tests motor (single/row/all) state using testSingleMotorState
 void testSystemMotorState(char row, char col) {
-  // Record baseline current reading
-  float i_total = 0;
   checkRelayPower();
-  for (uint8_t i = 0; i < 50; i++) {
-    i_total += ina219.getCurrent_mA();
-    delay(20);
+  float i_baseline = getIdleBaseline();
+  if (isnan(i_baseline)) {
+    // Record baseline current reading
+    float i_total = 0;
+    for (uint8_t i = 0; i < 50; i++) {
+      i_total += ina219.getCurrent_mA();
+      delay(20);
+    }
+    i_baseline = i_total / 50;
   }
-  float i_baseline = i_total / 50;
 
   if (!row && !col) {
     // Test every motor state in system
@@ -90,7 +96,7 @@ void testSystemMotorState(char row, char col) {
   } else if (!col) {
     // Test every motor state in row
     for (uint8_t col_idx = 0; col_idx < sizeof(col_keys)/sizeof(col_keys[0]); col_idx++) {
-        testSingleMotorState(row_keys[row], col_keys[col_idx], i_baseline);
+        testSingleMotorState(row, col_keys[col_idx], i_baseline);
         delay(5);
       }
   } else {
@@ -124,4 +130,185 @@ void sendMotorStateMatrix() {
     }
     delay(5);
   }
+}
+
+/*
+Folds one dispense into the motor's running statistics (Welford mean/variance, O(1) memory per motor)
+Drift is scored against the history *before* this run, so a sudden change shows up on the run that caused it
+Failed runs (result 1/2/4) are only counted, their current/timing is not representative of a healthy revolution
+current is NAN when it can't be attributed to this motor (concurrent dispense), only the time to home is folded in
+*/
+void updateMotorStats(char row, char col, uint8_t result, float current, float rev_time) {
+  uint8_t rowIdx = charToMatrixIdx(row);
+  uint8_t colIdx = charToMatrixIdx(col);
+  if (rowIdx == 255 | colIdx == 255) {
+    Logger.println("[Logger] [updateMotorStats] ERROR: invalid row/col input!");
+    return;
+  }
+  motorStatsStruct *stats = &motorStatsMatrix[rowIdx][colIdx];
+
+  if (result == 3) {return;} // Motor never ran
+  if (result != 0) {
+    stats->failures += 1;
+    return;
+  }
+
+  // Floor the standard deviations so a very consistent motor doesn't produce huge z-scores from sensor noise
+  bool hasCurrent = !isnan(current);
+  if (hasCurrent && stats->current_runs >= STATS_MIN_RUNS) {
+    float current_sd = fmaxf(sqrtf(stats->current_m2 / (stats->current_runs - 1)), 1.0f);
+    stats->current_z = (current - stats->current_mean) / current_sd;
+  }
+  if (stats->runs >= STATS_MIN_RUNS) {
+    float rev_sd = fmaxf(sqrtf(stats->rev_m2 / (stats->runs - 1)), 10.0f);
+    stats->rev_z = (rev_time - stats->rev_mean) / rev_sd;
+    float z = fmaxf(hasCurrent ? fabsf(stats->current_z) : 0.0f, fabsf(stats->rev_z));
+    stats->drift += (z - stats->drift) / STATS_DRIFT_WEIGHT;
+  }
+
+  if (hasCurrent) {
+    stats->current_runs += 1;
+    float delta = current - stats->current_mean;
+    stats->current_mean += delta / stats->current_runs;
+    stats->current_m2 += delta * (current - stats->current_mean);
+  }
+
+  stats->runs += 1;
+  float delta = rev_time - stats->rev_mean;
+  stats->rev_mean += delta / stats->runs;
+  stats->rev_m2 += delta * (rev_time - stats->rev_mean);
+}
+
+// Returns the smoothed drift score of a motor (0 until enough history), or -1 if invalid row/col input
+float getMotorDrift(char row, char col) {
+  uint8_t rowIdx = charToMatrixIdx(row);
+  uint8_t colIdx = charToMatrixIdx(col);
+  if (rowIdx == 255 | colIdx == 255) {
+    Logger.println("[Logger] [getMotorDrift] ERROR: invalid row/col input!");
+    return -1;
+  }
+  return motorStatsMatrix[rowIdx][colIdx].drift;
+}
+
+// Clears motor statistics (single/row/all), eg. after a spiral or motor has been swapped
+void clearMotorStats(char row, char col) {
+  for (uint8_t row_idx = 0; row_idx < sizeof(row_keys)/sizeof(row_keys[0]); row_idx++) {
+    if (row && row_keys[row_idx] != row) {continue;}
+    for (uint8_t col_idx = 0; col_idx < sizeof(col_keys)/sizeof(col_keys[0]); col_idx++) {
+      if (col && col_keys[col_idx] != col) {continue;}
+      motorStatsMatrix[row_idx][col_idx] = motorStatsStruct();
+    }
+  }
+}
+
+/*
+Sends motor statistics (single/row/all) as one line per motor over Serial and MQTT
+Format: STATS;<cell>;<runs>;<failures>;<i_mean>;<i_sd>;<t_mean>;<t_sd>;<drift>
+Motors with no recorded runs are skipped unless a single cell is requested
+*/
+void sendMotorStats(char row, char col) {
+  for (uint8_t row_idx = 0; row_idx < sizeof(row_keys)/sizeof(row_keys[0]); row_idx++) {
+    if (row && row_keys[row_idx] != row) {continue;}
+    for (uint8_t col_idx = 0; col_idx < sizeof(col_keys)/sizeof(col_keys[0]); col_idx++) {
+      if (col && col_keys[col_idx] != col) {continue;}
+      motorStatsStruct *stats = &motorStatsMatrix[row_idx][col_idx];
+      if (!col && stats->runs == 0 && stats->failures == 0) {continue;}
+
+      float current_sd = stats->current_runs > 1 ? sqrtf(stats->current_m2 / (stats->current_runs - 1)) : 0;
+      float rev_sd = stats->runs > 1 ? sqrtf(stats->rev_m2 / (stats->runs - 1)) : 0;
+      sendResponse("STATS;%c%c;%lu;%u;%.1f;%.1f;%.0f;%.0f;%.2f",
+        row_keys[row_idx], col_keys[col_idx], (unsigned long)stats->runs, stats->failures,
+        stats->current_mean, current_sd, stats->rev_mean, rev_sd, stats->drift);
+    }
+  }
+}
+
+/*
+Sends heap telemetry over Serial and MQTT: free heap, lowest free heap since boot and largest free block
+A shrinking largest block with steady free heap means the heap is fragmenting
+*/
+void sendHeapTelemetry() {
+  sendResponse("heap DONE FREE %u MIN %u LARGEST %u", ESP.getFreeHeap(), ESP.getMinFreeHeap(),
+    (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+}
+
+static float idleBaseline = 0.0; // EWMA of idle current (mA)
+static float idleNoise = 0.0; // EWMA of absolute deviation from baseline (mA)
+static uint32_t idleSamples = 0;
+static unsigned long idleUpdated = 0; // millis() of the last sample folded into the baseline
+static uint16_t idleFaults = 0;
+static float idleFaultCurrent = 0.0; // Latched fault awaiting sendIdleFaultReport
+static float idleFaultBaseline = 0.0;
+static volatile bool idleFaultPending = false;
+
+/*
+Samples the INA219 every IDLE_SAMPLE_INTERVAL_MS while no command holds currentSenseMutex, and not within IDLE_SETTLE_MS of a
+command releasing it
+Folds samples into an idle baseline and noise estimate (plain mean until IDLE_BASELINE_WEIGHT samples, then EWMA)
+Draw beyond the baseline (beyond IDLE_BASELINE_MAX_MA while the baseline is learned) for IDLE_FAULT_SAMPLES consecutive samples
+(welded relay, short) cuts all relays and is reported once until the current returns to normal. Fault samples are kept out of
+the baseline. The report is left to the MQTT task (sendIdleFaultReport)
+*/
+void idleMonitor(void * params) {
+  uint8_t fault_count = 0;
+  bool fault_latched = false;
+
+  while (true) {
+    delay(IDLE_SAMPLE_INTERVAL_MS);
+    if (xSemaphoreTake(currentSenseMutex, 0) != pdTRUE) {
+      fault_count = 0;
+      continue;
+    }
+    if (millis() - currentSenseReleased < IDLE_SETTLE_MS || areAnyRelaysOn) {
+      fault_count = 0;
+      xSemaphoreGive(currentSenseMutex);
+      continue;
+    }
+
+    float i_curr = ina219.getCurrent_mA();
+    float threshold = fmaxf(IDLE_FAULT_MIN_MA, IDLE_FAULT_SIGMA * 1.25f * idleNoise); // 1.25 * mean absolute deviation ~ sd
+    bool learning = idleSamples < IDLE_MIN_SAMPLES;
+    if (learning ? i_curr > IDLE_BASELINE_MAX_MA : i_curr - idleBaseline > threshold) {
+      fault_count += 1;
+      if (fault_count >= IDLE_FAULT_SAMPLES && !fault_latched) {
+        powerOffAll();
+        fault_latched = true;
+        idleFaults += 1;
+        logPrintf("[Logger] [idleMonitor] Unexpected idle current! i_curr = %f, i_baseline = %f\n", i_curr, idleBaseline);
+        idleFaultCurrent = i_curr;
+        idleFaultBaseline = learning ? 0.0 : idleBaseline;
+        idleFaultPending = true;
+      }
+      xSemaphoreGive(currentSenseMutex);
+      continue;
+    }
+    fault_count = 0;
+    fault_latched = false;
+
+    idleSamples += 1;
+    uint32_t weight = idleSamples < IDLE_BASELINE_WEIGHT ? idleSamples : IDLE_BASELINE_WEIGHT;
+    float deviation = fabsf(i_curr - idleBaseline);
+    idleBaseline += (i_curr - idleBaseline) / weight;
+    if (idleSamples > 1) {idleNoise += (deviation - idleNoise) / weight;}
+    idleUpdated = millis();
+    xSemaphoreGive(currentSenseMutex);
+  }
+}
+
+// Sends the fault latched by idleMonitor, if any. Format: Error;Idle;Current <mA>;Baseline <mA> (0 while the baseline is learned)
+void sendIdleFaultReport() {
+  if (!idleFaultPending) {return;}
+  idleFaultPending = false;
+  sendResponse("Error;Idle;Current %.1f;Baseline %.1f", idleFaultCurrent, idleFaultBaseline);
+}
+
+// Returns live idle current baseline (mA), NAN until IDLE_MIN_SAMPLES or if not refreshed within IDLE_BASELINE_MAX_AGE_MS
+float getIdleBaseline() {
+  if (idleSamples < IDLE_MIN_SAMPLES || millis() - idleUpdated > IDLE_BASELINE_MAX_AGE_MS) {return NAN;}
+  return idleBaseline;
+}
+
+// Sends idle monitor state over Serial and MQTT. Format: idle DONE BASELINE <mA> NOISE <mA> SAMPLES <n> FAULTS <n>
+void sendIdleMonitorStatus() {
+  sendResponse("idle DONE BASELINE %.2f NOISE %.2f SAMPLES %lu FAULTS %u", idleBaseline, idleNoise, (unsigned long)idleSamples, idleFaults);
 }
\ No newline at end of file
@@ -0,0 +1,229 @@
+#include <global.h>
+#include <journal.h>
+#include <command_handling.h>
+#include <motor_control.h>
+#include <esp_partition.h>
+#include <rom/crc.h>
+
+#define JOURNAL_RECORDS_PER_SECTOR (JOURNAL_SECTOR_SIZE / sizeof(journalRecord))
+#define JOURNAL_BLANK_SEQ 0xFFFFFFFF
+
+static const esp_partition_t *journalPartition = NULL;
+static uint32_t journalSlots = 0; // Record slots in the partition
+static uint32_t headSlot = 0; // Next slot to write
+static uint32_t nextSeq = 0;
+static uint16_t nextTxn = 0;
+static int32_t erasedSector = -1; // Sector the write head moves into next, once erased. -1 if unknown
+
+// Motors found interrupted (and homed) at boot
+static uint16_t recoveredTxn = 0;
+static uint8_t recoveredCount = 0;
+static char recoveredCells[8][2];
+
+static uint32_t recordCrc(const journalRecord *record) {
+  return crc32_le(0, (const uint8_t *)record, offsetof(journalRecord, crc));
+}
+
+static bool readRecord(uint32_t slot, journalRecord *record) {
+  return esp_partition_read(journalPartition, slot * sizeof(journalRecord), record, sizeof(journalRecord)) == ESP_OK;
+}
+
+static bool isValid(const journalRecord *record) {
+  return record->seq != JOURNAL_BLANK_SEQ && record->crc == recordCrc(record);
+}
+
+static bool isBlank(const journalRecord *record) {
+  const uint8_t *bytes = (const uint8_t *)record;
+  for (uint8_t i = 0; i < sizeof(journalRecord); i++) {
+    if (bytes[i] != 0xFF) {return false;}
+  }
+  return true;
+}
+
+static bool eraseSector(uint32_t sector) {
+  if (esp_partition_erase_range(journalPartition, sector * JOURNAL_SECTOR_SIZE, JOURNAL_SECTOR_SIZE) != ESP_OK) {
+    logPrintf("[Logger] [journal] Sector %u erase failed\n", sector);
+    return false;
+  }
+  erasedSector = sector;
+  return true;
+}
+
+/*
+Appends records (seq and crc filled in here), written with as few flash writes as possible
+A sector is only erased here if journalMaintain has not pre-erased it, which should not happen during normal operation
+*/
+static void appendRecords(journalRecord *records, uint8_t count) {
+  if (!journalPartition) {return;}
+  for (uint8_t i = 0; i < count; i++) {
+    records[i].seq = nextSeq++;
+    records[i].reserved = 0xFFFF;
+    records[i].crc = recordCrc(&records[i]);
+  }
+
+  uint8_t written = 0;
+  while (written < count) {
+    uint32_t sector = headSlot / JOURNAL_RECORDS_PER_SECTOR;
+    if (headSlot % JOURNAL_RECORDS_PER_SECTOR == 0 && erasedSector != (int32_t)sector) {
+      logPrintf("[Logger] [journal] Sector %u not pre-erased, erasing inline\n", sector);
+      eraseSector(sector);
+    }
+    // Contiguous run up to the end of the current sector
+    uint32_t room = JOURNAL_RECORDS_PER_SECTOR - headSlot % JOURNAL_RECORDS_PER_SECTOR;
+    uint8_t run = (uint32_t)(count - written) < room ? count - written : room;
+    if (esp_partition_write(journalPartition, headSlot * sizeof(journalRecord), &records[written], run * sizeof(journalRecord)) != ESP_OK) {
+      logPrintf("[Logger] [journal] Write at slot %u failed\n", headSlot);
+    }
+    written += run;
+    headSlot = (headSlot + run) % journalSlots;
+  }
+}
+
+/*
+Finds the journal partition and the write head (slot after the record with the highest sequence number)
+A partition without a single valid record (first boot after flashing the partition table) is erased
+Returns FALSE if the partition is missing, journaling is then disabled
+*/
+bool initJournal() {
+  journalPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, JOURNAL_PARTITION_LABEL);
+  if (!journalPartition) {
+    Logger.println("[Logger] [initJournal] No journal partition, journaling disabled (check partitions.csv)");
+    return false;
+  }
+  journalSlots = journalPartition->size / sizeof(journalRecord);
+
+  // Scan one sector at a time, a record batch at a time
+  journalRecord batch[16];
+  bool found = false;
+  uint32_t headSeq = 0;
+  for (uint32_t slot = 0; slot < journalSlots; slot += 16) {
+    if (esp_partition_read(journalPartition, slot * sizeof(journalRecord), batch, sizeof(batch)) != ESP_OK) {break;}
+    for (uint8_t i = 0; i < 16; i++) {
+      if (!isValid(&batch[i])) {continue;}
+      if (!found || batch[i].seq > headSeq) {
+        found = true;
+        headSeq = batch[i].seq;
+        headSlot = (slot + i + 1) % journalSlots;
+        nextTxn = batch[i].txn + 1;
+      }
+    }
+  }
+
+  if (!found) {
+    Logger.println("[Logger] [initJournal] Empty journal, formatting partition");
+    for (uint32_t sector = 0; sector < journalPartition->size / JOURNAL_SECTOR_SIZE; sector++) {eraseSector(sector);}
+    headSlot = 0;
+    nextSeq = 0;
+    nextTxn = 0;
+    erasedSector = 0;
+    return true;
+  }
+  nextSeq = headSeq + 1;
+
+  // Skip slots left half written by a power loss, they can't be programmed again until their sector is erased
+  journalRecord record;
+  while (headSlot % JOURNAL_RECORDS_PER_SECTOR != 0 && readRecord(headSlot, &record) && !isBlank(&record)) {
+    headSlot = (headSlot + 1) % journalSlots;
+  }
+  journalMaintain();
+  logPrintf("[Logger] [initJournal] Journal head at slot %u, seq %u\n", headSlot, nextSeq);
+  return true;
+}
+
+/*
+Checks the last transaction in the journal for motors that were started but never finished (power lost mid-dispense)
+Each interrupted motor is turned to its home position and a recovery record is appended
+Whether the interrupted vend dropped a product is unknown, sendJournalRecovery reports it for the host to reconcile
+*/
+void replayJournal() {
+  recoveredCount = 0;
+  if (!journalPartition || nextSeq == 0) {return;}
+
+  journalRecord record;
+  uint32_t slot = (headSlot + journalSlots - 1) % journalSlots;
+  if (!readRecord(slot, &record) || !isValid(&record)) {return;}
+  uint16_t txn = record.txn;
+
+  // Walk back over the transaction's records (newest first), collecting its cells and which of them finished
+  char started[8][2];
+  uint8_t startedCount = 0;
+  bool finished[8] = {};
+  for (uint8_t i = 0; i < JOURNAL_MAX_TXN_RECORDS; i++) {
+    if (!readRecord(slot, &record) || !isValid(&record) || record.txn != txn) {break;}
+    uint8_t k = 0;
+    while (k < startedCount && (started[k][0] != record.row || started[k][1] != record.col)) {k++;}
+    if (k == startedCount) {
+      if (startedCount == 8) {break;}
+      started[k][0] = record.row;
+      started[k][1] = record.col;
+      startedCount += 1;
+    }
+    if (record.type != JOURNAL_START) {finished[k] = true;}
+    slot = (slot + journalSlots - 1) % journalSlots;
+  }
+
+  for (uint8_t k = 0; k < startedCount; k++) {
+    if (finished[k]) {continue;}
+    char row = started[k][0];
+    char col = started[k][1];
+    logPrintf("[Logger] [replayJournal] Motor %c%c interrupted in txn %u, homing\n", row, col, txn);
+    sendMotorHome(row, col);
+    journalRecord recovery = {0, txn, JOURNAL_RECOVERED, row, col, 0, 0, 0};
+    appendRecords(&recovery, 1);
+    recoveredTxn = txn;
+    recoveredCells[recoveredCount][0] = row;
+    recoveredCells[recoveredCount][1] = col;
+    recoveredCount += 1;
+  }
+}
+
+// Sends one line per motor homed at boot. Format: Error;Motor <cell>;Interrupted TXN <txn>
+void sendJournalRecovery() {
+  for (uint8_t k = 0; k < recoveredCount; k++) {
+    sendResponse("Error;Motor %c%c;Interrupted TXN %u", recoveredCells[k][0], recoveredCells[k][1], recoveredTxn);
+  }
+}
+
+// Sends journal head and boot recovery. Format: JRNL;<next seq>;<next txn>;<head slot>/<slots>
+void sendJournalStatus() {
+  if (!journalPartition) {
+    sendResponse("JRNL;DISABLED");
+    return;
+  }
+  sendResponse("JRNL;%u;%u;%u/%u", nextSeq, nextTxn, headSlot, journalSlots);
+  sendJournalRecovery();
+}
+
+// Records the start of a motor run (one col) or concurrent batch (several cols of one row) in a single flash write
+uint16_t journalStart(char row, const char *cols, uint8_t count) {
+  uint16_t txn = nextTxn++;
+  journalRecord records[8];
+  if (count > 8) {count = 8;}
+  for (uint8_t i = 0; i < count; i++) {
+    records[i] = {0, txn, JOURNAL_START, row, cols[i], 0, 0, 0};
+  }
+  appendRecords(records, count);
+  return txn;
+}
+
+// Records the results of a motor run or concurrent batch once its motors are powered off, in a single flash write
+void journalFinish(uint16_t txn, char row, const char *cols, const uint8_t *results, uint8_t count) {
+  journalRecord records[8];
+  if (count > 8) {count = 8;}
+  for (uint8_t i = 0; i < count; i++) {
+    records[i] = {0, txn, JOURNAL_FINISH, row, cols[i], results[i], 0, 0};
+  }
+  appendRecords(records, count);
+}
+
+/*
+Keeps the sector the write head moves into next erased (the head's own sector if the head sits at its start),
+so appends during a dispense never wait for an erase. The erase drops that sector's (oldest) records
+*/
+void journalMaintain() {
+  if (!journalPartition) {return;}
+  uint32_t sectors = journalSlots / JOURNAL_RECORDS_PER_SECTOR;
+  uint32_t next = headSlot / JOURNAL_RECORDS_PER_SECTOR;
+  if (headSlot % JOURNAL_RECORDS_PER_SECTOR != 0) {next = (next + 1) % sectors;}
+  if (erasedSector != (int32_t)next) {eraseSector(next);}
+}
@@ -1,5 +1,8 @@
 #include <global.h>
 #include <motor_control.h>
+#include <planogram.h>
+#include <journal.h>
+#include <diagnostics.h>
 
 // Global variable definitions
 Adafruit_INA219 ina219;
@@ -10,9 +13,12 @@ HardwareSerial Logger(0);
 TaskHandle_t commandHandlerTaskHandle = NULL;
 TaskHandle_t serialHandlerTaskHandle = NULL;
 TaskHandle_t checkMQTTStatusHandle = NULL;
+TaskHandle_t idleMonitorTaskHandle = NULL;
 QueueHandle_t commandQueue = NULL;
 
 SemaphoreHandle_t androidConfirmation;
+SemaphoreHandle_t currentSenseMutex; // Held by commandHandler while a command runs, the idle monitor samples only when free
+volatile unsigned long currentSenseReleased = 0; // millis() when commandHandler last released currentSenseMutex
 
 void setup(void) 
 {
@@ -68,10 +74,18 @@ void setup(void)
   }
   ina219.setCalibration_32V_1A();
 
-  // Create commandQueue and confirm creation before proceeding
+  // Restore per motor stall/jam tuning and product to cell mapping used by vend commands
+  loadMotorTuning();
+  loadPlanogram();
+
+  // Home any motor left mid-revolution by a power loss, reported once MQTT is up
+  if (initJournal()) {
+    replayJournal();
+  }
+
+  // Create commandQueue and command pool, confirm creation before proceeding
   while (1) {
-    commandQueue = xQueueCreate(COMMAND_QUEUE_LEN, sizeof(commandStruct));
-    if (commandQueue == NULL) {
+    if (!initCommandPool()) {
       Logger.println("[Logger] commandQueue creation failed. Retrying...");
     } else {
       Logger.println("[Logger] commandQueue created.");
@@ -79,6 +93,12 @@ void setup(void)
     }
   }
   
+  // INA219 is shared by commandHandler and the idle monitor
+  while ((currentSenseMutex = xSemaphoreCreateMutex()) == NULL) {
+    Logger.println("[Logger] currentSenseMutex creation failed. Retrying...");
+    delay(5);
+  }
+
   // Create tasks and confirm creation before proceeding
   Logger.println("[Logger] Creating FreeRTOS tasks...");
   
@@ -87,7 +107,8 @@ void setup(void)
     (
       xTaskCreate(commandHandler, "commandHandlerTask", 3072, NULL, 1, &commandHandlerTaskHandle) == pdPASS &&
       xTaskCreate(serialHandler, "serialHandlerTask", 2048, NULL, 1, &serialHandlerTaskHandle) == pdPASS &&
-      xTaskCreate(checkMQTT, "checkMQTTTask", 2048, NULL, 1, &checkMQTTStatusHandle) == pdPASS
+      xTaskCreate(checkMQTT, "checkMQTTTask", 2048, NULL, 1, &checkMQTTStatusHandle) == pdPASS &&
+      xTaskCreate(idleMonitor, "idleMonitorTask", 2048, NULL, tskIDLE_PRIORITY, &idleMonitorTaskHandle) == pdPASS
     ) 
     {
       Logger.println("[Logger] [Main] All tasks created successfully.");
@@ -97,6 +118,7 @@ void setup(void)
       if (commandHandlerTaskHandle != NULL) {vTaskDelete(commandHandlerTaskHandle);}
       if (serialHandlerTaskHandle != NULL) {vTaskDelete(serialHandlerTaskHandle);}
       if (checkMQTTStatusHandle != NULL) {vTaskDelete(checkMQTTStatusHandle);}
+      if (idleMonitorTaskHandle != NULL) {vTaskDelete(idleMonitorTaskHandle);}
     }
     delay(5);
   }
@@ -104,6 +126,11 @@ void setup(void)
   // Create global Android confirmation semaphore
   androidConfirmation = xSemaphoreCreateBinary();
 
+  // Drive serialHandler from UART receive events: the RX idle timeout of 1 symbol ends a burst, so a command is
+  // handed over ~0.1 ms after its last byte instead of waiting for polling or the stream timeout
+  Serial.setRxTimeout(1);
+  Serial.onReceive(serialReceiveCallback, false);
+
   delay(100);
   Logger.println("[Logger] MotorControl Ready");
   Serial.println("MotorControl Ready");
@@ -111,6 +138,7 @@ void setup(void)
   Logger.println("[Logger] Setting up WiFi...");
   setup_wifi();
   setup_mqtt();
+  sendJournalRecovery();
 }
 
 void loop(void) {}
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include <global.h>
 #include <motor_control.h>
 #include <diagnostics.h>
+#include <journal.h>
+#include <Preferences.h>
 
 bool areAnyRelaysOn = false;
 const float motorResistor = 500.0;
@@ -11,6 +13,68 @@ uint8_t row_values[6] = {0, 1, 2, 3, 4, 5}; // Relay GPIO row pin
 const char col_keys[8] = {'1', '2', '3', '4', '5', '6', '7', '8'}; // Col index
 uint8_t col_values[8] = {8, 9, 10, 11, 12, 13, 14, 15}; // Relay GPIO col pin
 
+motorTuningStruct motorTuningMatrix[6][8];
+
+// Restores per motor stall/jam detection tuning from NVS, falls back to defaults if nothing (or an incompatible layout) was stored
+void loadMotorTuning() {
+  Preferences prefs;
+  prefs.begin("tuning", true);
+  if (prefs.getBytesLength("table") == sizeof(motorTuningMatrix)) {
+    prefs.getBytes("table", motorTuningMatrix, sizeof(motorTuningMatrix));
+    Logger.println("[Logger] [loadMotorTuning] Motor tuning restored from NVS");
+  } else {
+    for (uint8_t i = 0; i < 6; i++) {
+      for (uint8_t j = 0; j < 8; j++) {
+        motorTuningMatrix[i][j] = {DEFAULT_OUTLIER_DELTA, DEFAULT_MAX_OUTLIERS, DEFAULT_OVERCURRENT_LIMIT};
+      }
+    }
+  }
+  prefs.end();
+}
+
+// Returns stall/jam detection tuning of a motor (defaults if invalid row/col input)
+motorTuningStruct getMotorTuning(char row, char col) {
+  uint8_t rowIdx = charToMatrixIdx(row);
+  uint8_t colIdx = charToMatrixIdx(col);
+  if (rowIdx == 255 | colIdx == 255) {
+    return {DEFAULT_OUTLIER_DELTA, DEFAULT_MAX_OUTLIERS, DEFAULT_OVERCURRENT_LIMIT};
+  }
+  return motorTuningMatrix[rowIdx][colIdx];
+}
+
+/*
+Sets stall/jam detection tuning of a motor from "<outlier_delta>,<max_outliers>,<overcurrent_limit>" and persists it to NVS
+Empty values restores defaults
+Returns FALSE (tuning unchanged) if values are invalid
+*/
+bool setMotorTuning(char row, char col, const char *values) {
+  uint8_t rowIdx = charToMatrixIdx(row);
+  uint8_t colIdx = charToMatrixIdx(col);
+  if (rowIdx == 255 | colIdx == 255) {return false;}
+
+  motorTuningStruct tuning = {DEFAULT_OUTLIER_DELTA, DEFAULT_MAX_OUTLIERS, DEFAULT_OVERCURRENT_LIMIT};
+  if (*values) {
+    float outlier_delta, overcurrent_limit;
+    unsigned int max_outliers;
+    if (sscanf(values, "%f,%u,%f", &outlier_delta, &max_outliers, &overcurrent_limit) != 3) {return false;}
+    if (outlier_delta <= 0 || max_outliers == 0 || max_outliers > 255 || overcurrent_limit <= 0) {return false;}
+    tuning = {outlier_delta, (uint8_t)max_outliers, overcurrent_limit};
+  }
+  motorTuningMatrix[rowIdx][colIdx] = tuning;
+
+  Preferences prefs;
+  prefs.begin("tuning", false);
+  size_t written = prefs.putBytes("table", motorTuningMatrix, sizeof(motorTuningMatrix));
+  prefs.end();
+  return written == sizeof(motorTuningMatrix);
+}
+
+// Sends stall/jam detection tuning of a motor over Serial and MQTT. Format: TUNE;<cell>;<outlier_delta>,<max_outliers>,<overcurrent_limit>
+void sendMotorTuning(char row, char col) {
+  motorTuningStruct tuning = getMotorTuning(row, col);
+  sendResponse("TUNE;%c%c;%.1f,%u,%.1f", row, col, tuning.outlier_delta, tuning.max_outliers, tuning.overcurrent_limit);
+}
+
 // Helper function to set all relay GPIOs to output mode
 void relayPinSetup() {
   for (uint8_t i = 0; i < 16; i++) {
@@ -109,13 +173,13 @@ void sendMotorHome(char row, char col) {
     float i_curr = ina219.getCurrent_mA();
 
     if (millis() - start_time > timeout) {
-      Logger.printf("[Logger] Motor %c%c home timeout error!\n", row, col);
+      logPrintf("[Logger] Motor %c%c home timeout error!\n", row, col);
       break;
     }
 
     if (i_curr - i_ave > home_delta && poll_count > 2) {
       #ifdef CURRENT_LOGGING_ON
-      Logger.printf("[Logger] Home, i_curr = %f\t", i_curr);
+      logPrintf("[Logger] Home, i_curr = %f\t", i_curr);
       #endif
       home_count += 1;
     } else {
@@ -124,7 +188,7 @@ void sendMotorHome(char row, char col) {
       i_total += i_curr;
       i_ave = i_total / poll_count;
       #ifdef CURRENT_LOGGING_ON
-      Logger.printf("[Logger] Log, i_ave = %f\t", i_ave);
+      logPrintf("[Logger] Log, i_ave = %f\t", i_ave);
       #endif
     }
     
@@ -134,45 +198,77 @@ void sendMotorHome(char row, char col) {
   relayControl(row, col, 0);
 }
 
-/*
-Supplies power to selected motor, conducts current sensing to cut power when home condition is detected
-Returns uint8_t: 0 = home reached successfully, 1 = current outlier error, 2 = home timeout error, 3 = motor previously flagged and not cleared
-*/
-uint8_t runMotorOneRev(char row, char col) {
+// Revolution of one motor without journaling, see runMotorOneRev
+static uint8_t spinMotorOneRev(char row, char col) {
 
   float i_total = 0.0; // Rolling sum of current readings in mA
   float i_ave = 0.0; // Rolling average of current in mA
-  float outlier_delta = 50.0; // Delta for outlier rejection during revolution period (mA)
   float home_delta = 24.0 / motorResistor * 1000.0 - 10.0; // Delta to detect home state after revolution period (24V / 500ohm * 1000mA - allowance)
+  motorTuningStruct tuning = getMotorTuning(row, col);
+  float outlier_delta = tuning.outlier_delta; // Delta beyond the home step for outlier rejection during revolution period (mA)
 
   uint16_t poll_count = 0;
-  uint8_t outlier_count = 0;
-  uint8_t max_allowable_outliers = 20;
+  uint8_t outlier_count = 0; // Consecutive outlier samples
+  uint8_t max_allowable_outliers = tuning.max_outliers;
+  uint8_t overcurrent_count = 0; // Consecutive samples above the overcurrent limit
   uint8_t home_count = 0;
   uint8_t poll_interval = 5; // Interval between polls
   uint16_t delay_period = 250; // Motor starts turning < t < Cam leaves home position
-  uint16_t revolution_period = 1500; // Cam leaves home position < t < Cam almost returning to home position
   uint16_t timeout = 4000; // If home return not detected before timeout, return false
+  float i_idle = getIdleBaseline(); // Sensor offset from the idle monitor, overcurrent is judged above it
+  if (isnan(i_idle)) {i_idle = 0.0;}
 
-  // Logger.printf("[Logger] Motor %c%c: 'I'm working on it boss'\n",row,col);
+  // logPrintf("[Logger] Motor %c%c: 'I'm working on it boss'\n",row,col);
   if (!relayControl(row, col, 1)) {return 3;}
   unsigned long start_time = millis();
 
-  // Delay until out of home position
-  delay(delay_period);
-
   while (home_count < 5) {
     float i_curr = ina219.getCurrent_mA();
 
     if (millis() - start_time > timeout) {
       relayControl(row, col, 0);
-      Logger.printf("[Logger] Motor %c%c home timeout error!\n", row, col);
+      logPrintf("[Logger] Motor %c%c home timeout error!\n", row, col);
+      updateMotorStats(row, col, 2, i_ave, millis() - start_time);
       return 2;
     }
 
+    // Hard overcurrent (stalled/shorted motor) is checked from power on, a few samples ride through start-up inrush
+    if (i_curr - i_idle > tuning.overcurrent_limit) {
+      overcurrent_count += 1;
+      if (overcurrent_count >= MOTOR_OVERCURRENT_SAMPLES) {
+        relayControl(row, col, 0);
+        logPrintf("[Logger] Motor %c%c overcurrent error! i_curr = %f\n", row, col, i_curr);
+        updateMotorStats(row, col, 4, i_ave, millis() - start_time);
+        return 4;
+      }
+    } else {
+      overcurrent_count = 0;
+    }
+
+    // Delay until out of home position
+    if (millis() - start_time < delay_period) {
+      delay(poll_interval);
+      continue;
+    }
+
+    // Excursion larger than a home event can explain (jam), excluded from the rolling average
+    if (i_curr - i_ave > home_delta + outlier_delta && poll_count > 20) {
+      outlier_count += 1;
+      home_count = 0;
+      if (outlier_count >= max_allowable_outliers) {
+        relayControl(row, col, 0);
+        logPrintf("[Logger] Motor %c%c current outlier error! i_curr = %f, i_ave = %f\n", row, col, i_curr, i_ave);
+        updateMotorStats(row, col, 1, i_ave, millis() - start_time);
+        return 1;
+      }
+      delay(poll_interval);
+      continue;
+    }
+    outlier_count = 0;
+
     if (i_curr - i_ave > home_delta && poll_count > 250) {
       #ifdef CURRENT_LOGGING_ON
-      Logger.printf("[Logger] Home, i_curr = %f\t", i_curr);
+      logPrintf("[Logger] Home, i_curr = %f\t", i_curr);
       #endif
       home_count += 1;
     } else {
@@ -181,12 +277,324 @@ uint8_t runMotorOneRev(char row, char col) {
       i_total += i_curr;
       i_ave = i_total / poll_count;
       #ifdef CURRENT_LOGGING_ON
-      Logger.printf("[Logger] Log, i_ave = %f\t", i_ave);
+      logPrintf("[Logger] Log, i_ave = %f\t", i_ave);
       #endif
     }
     delay(poll_interval);
   }
 
   relayControl(row, col, 0);
+  updateMotorStats(row, col, 0, i_ave, millis() - start_time);
   return 0; // Successfully reached home
+}
+
+/*
+Supplies power to selected motor, conducts current sensing to cut power when home condition is detected
+Stalls/jams are aborted early: sustained excursions beyond the home step (outlier) or past the absolute overcurrent limit
+The run is journaled (start before power on, result after power off) so a power loss mid-revolution is recovered at boot
+Returns uint8_t: 0 = home reached successfully, 1 = current outlier error, 2 = home timeout error, 3 = motor previously flagged and not cleared, 4 = overcurrent error
+*/
+uint8_t runMotorOneRev(char row, char col) {
+  uint16_t txn = journalStart(row, &col, 1);
+  uint8_t result = spinMotorOneRev(row, col);
+  journalFinish(txn, row, &col, &result, 1);
+  return result;
+}
+
+// Expected run current of a motor, from its statistics if available
+static float expectedMotorCurrent(char row, char col) {
+  motorStatsStruct *stats = &motorStatsMatrix[charToMatrixIdx(row)][charToMatrixIdx(col)];
+  if (stats->current_runs >= STATS_MIN_RUNS) {return stats->current_mean;}
+  return MOTOR_NOMINAL_CURRENT_MA;
+}
+
+/*
+Home window of a motor in a concurrent batch, relative to its start: its mean revolution time +/- CONCURRENT_HOME_WINDOW_SD
+standard deviations (at least CONCURRENT_HOME_WINDOW_MIN_MS)
+Returns FALSE if the motor has too little history for its home event to be attributed in the combined current
+*/
+static bool concurrentHomeWindow(char row, char col, float *expected, float *halfWidth) {
+  motorStatsStruct *stats = &motorStatsMatrix[charToMatrixIdx(row)][charToMatrixIdx(col)];
+  if (stats->runs < STATS_MIN_RUNS) {return false;}
+  *expected = stats->rev_mean;
+  *halfWidth = fmaxf(CONCURRENT_HOME_WINDOW_MIN_MS, CONCURRENT_HOME_WINDOW_SD * sqrtf(stats->rev_m2 / (stats->runs - 1)));
+  return true;
+}
+
+/*
+Runs a batch of motors on one row concurrently (row relay held on, one col relay per motor)
+Motors are started CONCURRENT_STAGGER_MS apart. Home events are detected as a step in the combined current and credited
+to the one motor whose home window (see concurrentHomeWindow) is open, whose col is then cut. A motor whose window closes
+without a home event is cut as a home timeout. A home event in no window, in several windows, or while the combined current
+is still being re-averaged after a start/cut can't be attributed: every running motor is cut with error 1 rather than
+guessing (a wrong guess would cut one motor mid revolution and let another overrun into a second vend)
+The combined current is also held against the sum of the running motors' overcurrent limits from power on, exceeding it
+for MOTOR_OVERCURRENT_SAMPLES consecutive samples cuts every running motor with error 4
+Only attributed results (home, home timeout) flag motors and update their statistics, a batch abort (error 1 or 4) can't be
+pinned on one motor so its motors are reported but left unflagged
+Batches are planned by runMotorsConcurrent so that no window opens during another motor's start, home confirmation, cut or
+re-baseline (see CONCURRENT_HOME_BUSY_MS)
+Starts are journaled for the whole batch, each motor's finish as soon as its col is cut, so a power loss mid batch only
+homes the motors that were still running
+Every col must be unflagged (runMotorsConcurrent leaves flagged cols out), so each motor starts at its planned offset
+*/
+static void runConcurrentBatch(char row, const char *cols, uint8_t count, uint8_t *results) {
+  float i_total = 0.0; // Rolling sum of combined current readings since the last start/cut (mA)
+  float i_ave = 0.0; // Rolling average of combined current since the last start/cut (mA)
+  float home_delta = 24.0 / motorResistor * 1000.0 - 10.0; // Delta to detect home state after revolution period (24V / 500ohm * 1000mA - allowance)
+
+  uint16_t poll_count = 0;
+  uint8_t outlier_count = 0; // Consecutive outlier samples
+  uint8_t overcurrent_count = 0; // Consecutive samples above the combined overcurrent limit
+  uint8_t home_count = 0;
+  uint8_t poll_interval = 5; // Interval between polls
+  uint16_t timeout = 4000; // If home return not detected before timeout, cut motor
+  float i_idle = getIdleBaseline(); // Sensor offset from the idle monitor, overcurrent is judged above it
+  if (isnan(i_idle)) {i_idle = 0.0;}
+
+  unsigned long start_time[CONCURRENT_MAX_MOTORS];
+  float expected_home[CONCURRENT_MAX_MOTORS]; // Home window centre relative to start (ms)
+  float home_window[CONCURRENT_MAX_MOTORS]; // Home window half width (ms)
+  bool running[CONCURRENT_MAX_MOTORS] = {};
+  uint8_t started = 0;
+  uint8_t finished = 0;
+
+  uint16_t txn = journalStart(row, cols, count);
+  checkRelayPower();
+  relayGPIO.digitalWrite(getPin(row), HIGH);
+  areAnyRelaysOn = true;
+
+  unsigned long settle_until = millis(); // Sampling resumes, the combined current is re-averaged from here
+  unsigned long next_start = millis();
+
+  while (finished < count) {
+    unsigned long now = millis();
+
+    // Start next motor in the batch
+    if (started < count && now >= next_start) {
+      uint8_t k = started++;
+      concurrentHomeWindow(row, cols[k], &expected_home[k], &home_window[k]);
+      relayGPIO.digitalWrite(getPin(cols[k]), HIGH);
+      start_time[k] = now;
+      running[k] = true;
+      next_start = now + CONCURRENT_STAGGER_MS;
+      settle_until = now + CONCURRENT_START_SETTLE_MS;
+      i_total = 0.0;
+      poll_count = 0;
+      home_count = 0;
+      continue;
+    }
+
+    float i_curr = ina219.getCurrent_mA();
+
+    // Cut motors that timed out or whose home window closed without a home event
+    for (uint8_t k = 0; k < started; k++) {
+      if (running[k] && (now - start_time[k] > timeout || now - start_time[k] > expected_home[k] + home_window[k])) {
+        relayGPIO.digitalWrite(getPin(cols[k]), LOW);
+        running[k] = false;
+        results[k] = 2;
+        finished += 1;
+        journalFinish(txn, row, &cols[k], &results[k], 1);
+        setMotorState(row, cols[k], 2);
+        logPrintf("[Logger] Motor %c%c home timeout error!\n", row, cols[k]);
+        updateMotorStats(row, cols[k], 2, NAN, now - start_time[k]);
+        settle_until = now + CONCURRENT_CUT_SETTLE_MS;
+        i_total = 0.0;
+        poll_count = 0;
+        home_count = 0;
+      }
+    }
+
+    // Hard overcurrent is checked from power on against the running motors' combined limit, can't tell which motor drew it
+    float overcurrent_limit = 0.0;
+    for (uint8_t k = 0; k < started; k++) {
+      if (running[k]) {overcurrent_limit += getMotorTuning(row, cols[k]).overcurrent_limit;}
+    }
+    if (finished < started && i_curr - i_idle > overcurrent_limit) {
+      overcurrent_count += 1;
+    } else {
+      overcurrent_count = 0;
+    }
+    if (overcurrent_count >= MOTOR_OVERCURRENT_SAMPLES) {
+      logPrintf("[Logger] Row %c concurrent overcurrent error! i_curr = %f\n", row, i_curr);
+      for (uint8_t k = 0; k < started; k++) {
+        if (!running[k]) {continue;}
+        relayGPIO.digitalWrite(getPin(cols[k]), LOW);
+        running[k] = false;
+        results[k] = 4;
+        finished += 1;
+        journalFinish(txn, row, &cols[k], &results[k], 1);
+      }
+      overcurrent_count = 0;
+      continue;
+    }
+
+    if (now < settle_until) {
+      delay(poll_interval);
+      continue;
+    }
+
+    // Motors whose home window is open, and whether any opened before the combined current was re-averaged
+    bool rebaselined = now - settle_until >= CONCURRENT_REBASELINE_MS && poll_count > 0;
+    int8_t candidate = -1;
+    uint8_t open_windows = 0;
+    for (uint8_t k = 0; k < started; k++) {
+      if (running[k] && now - start_time[k] >= expected_home[k] - home_window[k]) {
+        candidate = k;
+        open_windows += 1;
+      }
+    }
+    bool unattributable = open_windows > 1 || (open_windows > 0 && !rebaselined);
+
+    // Jam in one of the running motors can't be attributed from the combined current, cut all of them
+    float outlier_delta = DEFAULT_OUTLIER_DELTA;
+    uint8_t max_allowable_outliers = DEFAULT_MAX_OUTLIERS;
+    for (uint8_t k = 0; k < started; k++) {
+      if (!running[k]) {continue;}
+      motorTuningStruct tuning = getMotorTuning(row, cols[k]);
+      outlier_delta = fminf(outlier_delta, tuning.outlier_delta);
+      if (tuning.max_outliers < max_allowable_outliers) {max_allowable_outliers = tuning.max_outliers;}
+    }
+    bool outlier = i_curr - i_ave > home_delta + outlier_delta && rebaselined && poll_count > 20;
+    if (outlier) {
+      outlier_count += 1;
+      home_count = 0;
+    } else {
+      outlier_count = 0;
+    }
+    // Home step, counted once the combined current has been re-averaged after the last start/cut
+    if (!outlier && i_curr - i_ave > home_delta && rebaselined) {
+      #ifdef CURRENT_LOGGING_ON
+      logPrintf("[Logger] Home, i_curr = %f\t", i_curr);
+      #endif
+      home_count += 1;
+    } else if (!outlier) {
+      home_count = 0;
+    }
+
+    bool confirmed = home_count >= CONCURRENT_HOME_CONFIRM_SAMPLES;
+    if (outlier_count >= max_allowable_outliers || unattributable || (confirmed && open_windows != 1)) {
+      logPrintf("[Logger] Row %c concurrent %s error!\n", row, outlier_count >= max_allowable_outliers ? "current outlier" : "unattributed home");
+      // Not flagged and not counted as a failure: the fault can't be pinned on one motor, disp finds it on its own
+      for (uint8_t k = 0; k < started; k++) {
+        if (!running[k]) {continue;}
+        relayGPIO.digitalWrite(getPin(cols[k]), LOW);
+        running[k] = false;
+        results[k] = 1;
+        finished += 1;
+        journalFinish(txn, row, &cols[k], &results[k], 1);
+      }
+      outlier_count = 0;
+      home_count = 0;
+
+    } else if (confirmed) {
+      relayGPIO.digitalWrite(getPin(cols[candidate]), LOW);
+      running[candidate] = false;
+      results[candidate] = 0;
+      finished += 1;
+      journalFinish(txn, row, &cols[candidate], &results[candidate], 1);
+      setMotorState(row, cols[candidate], 0);
+      updateMotorStats(row, cols[candidate], 0, NAN, now - start_time[candidate]);
+      settle_until = now + CONCURRENT_CUT_SETTLE_MS;
+      i_total = 0.0;
+      poll_count = 0;
+      home_count = 0;
+
+    } else if (!outlier && home_count == 0) {
+      poll_count += 1;
+      i_total += i_curr;
+      i_ave = i_total / poll_count;
+      #ifdef CURRENT_LOGGING_ON
+      logPrintf("[Logger] Log, i_ave = %f\t", i_ave);
+      #endif
+    }
+    delay(poll_interval);
+  }
+
+  powerOffAll();
+}
+
+// TRUE if intervals [a_start, a_end] and [b_start, b_end] are at least gap apart
+static bool intervalsApart(float a_start, float a_end, float b_start, float b_end, float gap) {
+  return b_start - a_end >= gap || a_start - b_end >= gap;
+}
+
+/*
+Dispenses from several cols of one row, running as many motors at once as the cabinet current budget allows
+Flagged cols are reported and skipped before planning. Cols are only batched together if, at CONCURRENT_STAGGER_MS start
+offsets, no home window opens within CONCURRENT_HOME_BUSY_MS of another window (confirmation, cut, settle, re-baseline) or
+within CONCURRENT_START_SETTLE_MS + CONCURRENT_REBASELINE_MS of a start, each plus CONCURRENT_PLAN_MARGIN_MS. Cols without
+revolution history, or that can't be separated from the cols before them, run on their own with runMotorOneRev
+Writes one runMotorOneRev style result per col (0 = home reached, 1 = current outlier, 2 = home timeout, 3 = motor flagged,
+4 = overcurrent) and sets motorStateMatrix for attributed results (see runConcurrentBatch)
+Returns number of successful dispenses
+*/
+uint8_t runMotorsConcurrent(char row, const char *cols, uint8_t count, uint8_t *results) {
+  // Flagged cols are reported up front and left out of the plan, a skipped slot would shift every later start
+  char healthy[8];
+  uint8_t healthy_idx[8];
+  uint8_t healthy_count = 0;
+  for (uint8_t k = 0; k < count && k < 8; k++) {
+    uint8_t motor_state = getMotorState(row, cols[k]);
+    if (motor_state != 0) {
+      Serial.printf("Error;Motor %c%c;Flag %u\n", row, cols[k], motor_state);
+      results[k] = 3;
+      continue;
+    }
+    healthy[healthy_count] = cols[k];
+    healthy_idx[healthy_count] = k;
+    healthy_count += 1;
+  }
+
+  uint8_t batch_results[CONCURRENT_MAX_MOTORS];
+  uint8_t done = 0;
+  while (done < healthy_count) {
+    // Fill batch until current budget, stagger window or home window separation is reached
+    float budget = CABINET_CURRENT_BUDGET_MA;
+    float window_start[CONCURRENT_MAX_MOTORS]; // Home windows relative to the first start of the batch (ms)
+    float window_end[CONCURRENT_MAX_MOTORS];
+    uint8_t batch = 0;
+    while (done + batch < healthy_count && batch < CONCURRENT_MAX_MOTORS) {
+      char col = healthy[done + batch];
+      float expected, halfWidth;
+      if (!concurrentHomeWindow(row, col, &expected, &halfWidth)) {break;}
+      float expected_current = expectedMotorCurrent(row, col);
+      if (batch > 0 && expected_current > budget) {break;}
+      float offset = batch * CONCURRENT_STAGGER_MS;
+      float start_busy = CONCURRENT_START_SETTLE_MS + CONCURRENT_REBASELINE_MS + CONCURRENT_PLAN_MARGIN_MS;
+      float home_busy = CONCURRENT_HOME_BUSY_MS + CONCURRENT_PLAN_MARGIN_MS;
+      bool separated = true;
+      for (uint8_t k = 0; k < batch; k++) {
+        float start_k = k * CONCURRENT_STAGGER_MS;
+        if (!intervalsApart(window_start[k], window_end[k], offset + expected - halfWidth, offset + expected + halfWidth, home_busy) ||
+            !intervalsApart(window_start[k], window_end[k], offset, offset + start_busy, 0) ||
+            !intervalsApart(start_k, start_k + start_busy, offset + expected - halfWidth, offset + expected + halfWidth, 0)) {
+          separated = false;
+        }
+      }
+      if (!separated) {break;}
+      window_start[batch] = offset + expected - halfWidth;
+      window_end[batch] = offset + expected + halfWidth;
+      budget -= expected_current;
+      batch += 1;
+    }
+
+    if (batch < 2) {
+      uint8_t result = runMotorOneRev(row, healthy[done]);
+      setMotorState(row, healthy[done], result);
+      results[healthy_idx[done]] = result;
+      done += 1;
+      continue;
+    }
+    logPrintf("[Logger] [runMotorsConcurrent] Row %c: running %u motors concurrently\n", row, batch);
+    runConcurrentBatch(row, healthy + done, batch, batch_results);
+    for (uint8_t k = 0; k < batch; k++) {results[healthy_idx[done + k]] = batch_results[k];}
+    done += batch;
+  }
+
+  uint8_t successes = 0;
+  for (uint8_t k = 0; k < count; k++) {
+    if (results[k] == 0) {successes += 1;}
+  }
+  return successes;
 }
\ No newline at end of file
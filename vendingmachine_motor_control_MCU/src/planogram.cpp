@@ -0,0 +1,135 @@
+#include <global.h>
+#include <planogram.h>
+#include <command_handling.h>
+#include <motor_control.h>
+#include <diagnostics.h>
+#include <Preferences.h>
+
+planogramEntry planogram[PLANOGRAM_MAX_PRODUCTS] = {};
+
+// Restores planogram from NVS, starts with an empty planogram if nothing (or an incompatible layout) was stored
+void loadPlanogram() {
+  Preferences prefs;
+  prefs.begin("planogram", true);
+  if (prefs.getBytesLength("table") == sizeof(planogram)) {
+    prefs.getBytes("table", planogram, sizeof(planogram));
+    Logger.println("[Logger] [loadPlanogram] Planogram restored from NVS");
+  } else {
+    memset(planogram, 0, sizeof(planogram));
+    Logger.println("[Logger] [loadPlanogram] No stored planogram, starting empty");
+  }
+  prefs.end();
+}
+
+// Persists whole planogram to NVS, returns FALSE if the write failed
+bool savePlanogram() {
+  Preferences prefs;
+  prefs.begin("planogram", false);
+  size_t written = prefs.putBytes("table", planogram, sizeof(planogram));
+  prefs.end();
+  return written == sizeof(planogram);
+}
+
+// Returns planogram entry for sku, NULL if sku is not mapped
+planogramEntry * findPlanogramEntry(const char *sku) {
+  if (!sku || !*sku) {return NULL;}
+  for (uint8_t i = 0; i < PLANOGRAM_MAX_PRODUCTS; i++) {
+    if (planogram[i].sku[0] && strcmp(planogram[i].sku, sku) == 0) {
+      return &planogram[i];
+    }
+  }
+  return NULL;
+}
+
+/*
+Maps sku to a comma separated list of cells (eg. "a1,a2,b3") and persists the planogram
+Empty cell list removes sku from planogram
+Returns FALSE (planogram unchanged) if sku/cells are invalid, a cell is listed twice or planogram is full
+*/
+bool setPlanogramEntry(const char *sku, const char *cells) {
+  size_t skuLen = strlen(sku);
+  if (skuLen == 0 || skuLen > SKU_MAX_LEN) {return false;}
+
+  planogramEntry entry = {};
+  strcpy(entry.sku, sku);
+
+  // Parse cell list
+  const char *p = cells;
+  while (*p) {
+    char row = rowValidator(p[0]);
+    char col = p[1];
+    if (!row || charToMatrixIdx(col) == 255 || (p[2] != ',' && p[2] != '\0')) {return false;}
+    if (entry.cellCount >= PLANOGRAM_MAX_CELLS) {return false;}
+    // A repeated cell would be retried by vendProduct after it just failed
+    for (uint8_t i = 0; i < entry.cellCount; i++) {
+      if (entry.cells[i][0] == row && entry.cells[i][1] == col) {return false;}
+    }
+    entry.cells[entry.cellCount][0] = row;
+    entry.cells[entry.cellCount][1] = col;
+    entry.cellCount += 1;
+    p += (p[2] == ',') ? 3 : 2;
+  }
+
+  planogramEntry *slot = findPlanogramEntry(sku);
+  if (entry.cellCount == 0) { // Remove sku
+    if (slot) {memset(slot, 0, sizeof(planogramEntry));}
+    return savePlanogram();
+  }
+  if (!slot) { // New sku, find free slot
+    for (uint8_t i = 0; i < PLANOGRAM_MAX_PRODUCTS; i++) {
+      if (!planogram[i].sku[0]) {
+        slot = &planogram[i];
+        break;
+      }
+    }
+    if (!slot) {
+      Logger.println("[Logger] [setPlanogramEntry] Planogram full!");
+      return false;
+    }
+  }
+  *slot = entry;
+  return savePlanogram();
+}
+
+/*
+Sends planogram over Serial and MQTT, one line per product (only sku if given)
+Format: PLAN;<sku>;<cell>,<cell>,...
+*/
+void sendPlanogram(const char *sku) {
+  char cells[PLANOGRAM_MAX_CELLS * 3];
+  for (uint8_t i = 0; i < PLANOGRAM_MAX_PRODUCTS; i++) {
+    if (!planogram[i].sku[0]) {continue;}
+    if (sku && *sku && strcmp(planogram[i].sku, sku) != 0) {continue;}
+    int len = 0;
+    cells[0] = '\0';
+    for (uint8_t j = 0; j < planogram[i].cellCount; j++) {
+      len += snprintf(cells + len, sizeof(cells) - len, "%s%c%c", j ? "," : "", planogram[i].cells[j][0], planogram[i].cells[j][1]);
+    }
+    sendResponse("PLAN;%s;%s", planogram[i].sku, cells);
+  }
+}
+
+/*
+Dispenses one item of a product, trying its cells in planogram order
+Flagged cells are skipped, cells failing with an outlier/timeout/overcurrent error are flagged and the next cell is tried
+Returns uint8_t: 0 = dispensed (row/col set to the cell that dispensed), otherwise the last runMotorOneRev error with row/col set to
+the last cell tried (3 and row/col '\0' if no healthy cell was available)
+*/
+uint8_t vendProduct(planogramEntry *entry, char *row, char *col) {
+  uint8_t result = 3;
+  *row = '\0';
+  *col = '\0';
+  for (uint8_t i = 0; i < entry->cellCount; i++) {
+    char cellRow = entry->cells[i][0];
+    char cellCol = entry->cells[i][1];
+    if (getMotorState(cellRow, cellCol) != 0) {continue;} // Skip flagged cells without touching the relays
+
+    result = runMotorOneRev(cellRow, cellCol);
+    setMotorState(cellRow, cellCol, result);
+    *row = cellRow;
+    *col = cellCol;
+    if (result == 0) {return 0;}
+    logPrintf("[Logger] [vendProduct] %c%c error %u, failing over\n", cellRow, cellCol, result);
+  }
+  return result;
+}